@@ -1,21 +1,11 @@
 //
 // https://adventofcode.com/2023/day/10
 //
-#include <set>
 #include <string>
 using namespace std::literals;
 
-#include <range/v3/algorithm/all_of.hpp>
-#include <range/v3/range/conversion.hpp>
-#include <range/v3/view/drop.hpp>
-#include <range/v3/view/iota.hpp>
-#include <range/v3/view/istream.hpp>
-#include <range/v3/view/transform.hpp>
-#include <range/v3/view/zip.hpp>
-using namespace ranges;
-using namespace ranges::views;
-
 #include "common.hpp"
+#include "frame.hpp"
 
 struct Coord
 {
@@ -30,89 +20,135 @@ struct Coord
    }
 };
 
-struct Tile
+//
+// A tile is a single byte: The lower four bits tell in which directions the pipe is connected,
+// in the same order as AROUND. The upper bits are flags.
+//
+using Tile = uint8_t;
+
+enum : Tile
 {
-   char symbol;
-   std::vector<Coord> connections;
-   std::string unicodeSymbol;
-   bool visited = false;
-   auto operator<=>(const Tile& other) const noexcept { return symbol <=> other.symbol; }
-   auto operator<=>(char symbol) const noexcept { return this->symbol <=> symbol; }
-   bool operator==(char symbol) const noexcept { return this->symbol == symbol; };
+   WEST = 1,
+   NORTH = 2,
+   EAST = 4,
+   SOUTH = 8,
+   PIPE = WEST | NORTH | EAST | SOUTH,
+   VISITED = 16,
+   START = 32,
+   INSIDE = 64,
 };
 
+const std::array<Coord, 4> AROUND = {{{-1, 0}, {0, -1}, {1, 0}, {0, 1}}};
+
+constexpr Tile opposite(Tile direction) { return ((direction << 2) | (direction >> 2)) & PIPE; }
+
 //
 // L is a 90-degree bend connecting north and east.
 // J is a 90-degree bend connecting north and west.
 // 7 is a 90-degree bend connecting south and west.
 // F is a 90-degree bend connecting south and east.
 //
-const std::set<Tile, std::less<>> PIPES = {
-   // clang-format off
-   {'-', {{{-1,  0}, { 1,  0}}}, "─"},
-   {'|', {{{ 0, -1}, { 0,  1}}}, "│"},
-   {'L', {{{ 0, -1}, { 1,  0}}}, "└"},
-   {'J', {{{ 0, -1}, {-1,  0}}}, "┘"},
-   {'7', {{{ 0,  1}, {-1,  0}}}, "┐"},
-   {'F', {{{ 0,  1}, { 1,  0}}}, "┌"},
-   {'.', {},                     "."},
-   {'I', {},                     "\x1b[44m \x1b[0m"},
-   {'O', {},                     "O"},
-   {'S', {{{-1, 0}, {0, -1}, {1, 0}, {0, 1}}}, "\x1b[1;31mS\x1b[0m"},
-   {'X', {{{-1, 0}, {0, -1}, {1, 0}, {0, 1}}}, "\x1b[1;31mX\x1b[0m"},
-   // clang-format on
-};
-
-const std::array<Coord, 4> AROUND = {{{-1, 0}, {0, -1}, {1, 0}, {0, 1}}};
-
-const Tile DOT = *PIPES.find('.');
+constexpr std::array<Tile, 256> PIPES = []
+{
+   std::array<Tile, 256> pipes{};
+   pipes['-'] = WEST | EAST;
+   pipes['|'] = NORTH | SOUTH;
+   pipes['L'] = NORTH | EAST;
+   pipes['J'] = NORTH | WEST;
+   pipes['7'] = SOUTH | WEST;
+   pipes['F'] = SOUTH | EAST;
+   pipes['S'] = PIPE | START;
+   return pipes;
+}();
+
+// indexed by the four direction bits
+constexpr std::array<std::string_view, 16> SYMBOLS = {
+   ".", "?", "?", "┘", "?", "─", "└", "?", "?", "┐", "│", "?", "┌", "?", "?", "S"};
 
 struct Map
 {
    explicit Map(std::ifstream file)
    {
-      for (std::string line; std::getline(file, line);)
-         map.emplace_back(line | transform([](char c) { return *PIPES.find(c); }) |
-                          to<std::vector>);
-
-      for (auto [row, y] : zip(map, ints))
-         for (auto [cell, x] : zip(row, ints))
-            if (cell.symbol == 'S')
-               start = Coord(x, y);
+      for (std::string line; std::getline(file, line) && !line.empty(); ++h)
+      {
+         assert(w == 0 || w == int(line.size()));
+         w = line.size();
+         for (char c : line)
+         {
+            if (c == 'S')
+               start = Coord(tiles.size() % w, h);
+            tiles.emplace_back(PIPES[uint8_t(c)]);
+         }
+      }
    }
 
-   std::vector<std::vector<Tile>> map;
+   int w = 0, h = 0;
+   std::vector<Tile> tiles;
    Coord start;
 
-   Tile& at(const Coord& c)
+   bool contains(const Coord& c) const { return c.x >= 0 && c.x < w && c.y >= 0 && c.y < h; }
+   Tile at(const Coord& c) const { return contains(c) ? tiles[c.y * w + c.x] : 0; }
+   Tile& cell(const Coord& c)
    {
-      static Tile mydot = DOT;
-      if (c.y >= 0 && c.y < map.size())
-         if (c.x >= 0 && c.x <= map[c.y].size())
-            return map[c.y][c.x];
-      return mydot; // yes I know I'm returning a non-const reference to a static here
+      assert(contains(c));
+      return tiles[c.y * w + c.x];
    }
 
-   bool isConnected(const Coord& a, const Coord& b)
+   // direction bit that leads from 'a' to its neighbour 'b'
+   static Tile direction(const Coord& a, const Coord& b)
    {
-      for (auto ca : at(a).connections)
-         for (auto cb : at(b).connections)
-            if (a + ca == b && b + cb == a)
-               return true;
-      return false;
+      for (size_t i = 0; i < AROUND.size(); ++i)
+         if (a + AROUND[i] == b)
+            return 1 << i;
+      return 0;
+   }
+
+   bool isConnected(const Coord& a, const Coord& b) const
+   {
+      auto dir = direction(a, b);
+      return (at(a) & dir) && (at(b) & opposite(dir));
    }
 
    void dump() const
    {
-      for (auto& row : map)
+      auto& frame = screen();
+      for (int y = 0; y < h; ++y)
       {
-         for (auto& cell : row)
-            if (cell.visited)
-               fmt::print("\x1b[1;32m{}\x1b[0m", cell.unicodeSymbol);
+         for (int x = 0; x < w; ++x)
+         {
+            auto tile = at({x, y});
+            auto symbol = SYMBOLS[tile & PIPE];
+            if (tile & START)
+               frame.append("\x1b[1;31mS\x1b[0m");
+            else if (tile & INSIDE)
+               frame.append("\x1b[44m \x1b[0m");
+            else if (tile & VISITED)
+               frame.print("\x1b[1;32m{}\x1b[0m", symbol);
             else
-               fmt::print("{}", cell.unicodeSymbol);
-         fmt::println("");
+               frame.append(symbol);
+         }
+         frame.newline();
       }
+      frame.flush();
+   }
+
+   Image image() const
+   {
+      Image image(w, h);
+      for (int y = 0; y < h; ++y)
+         for (int x = 0; x < w; ++x)
+         {
+            auto tile = at({x, y});
+            if (tile & START)
+               image.set(x, y, {255, 0, 0});
+            else if (tile & INSIDE)
+               image.set(x, y, {0, 0, 255});
+            else if (tile & VISITED)
+               image.set(x, y, {0, 255, 0});
+            else if (tile & PIPE)
+               image.set(x, y, {96, 96, 96});
+         }
+      return image;
    }
 };
 
@@ -123,20 +159,29 @@ int main(int argc, char* argv[])
    assert(map.start.x != -1 && map.start.y != -1);
    fmt::println("start at ({}, {})", map.start.x, map.start.y);
 
+   //
+   // Trace the loop. Besides marking the tiles as visited, accumulate twice the enclosed area using
+   // the shoelace formula. Only the previous and the second tile are kept, not the whole track.
+   //
    auto pos = map.start;
-   std::vector<Coord> track{};
+   Coord prev, second;
+   size_t length = 0;
+   long area2 = 0;
    for (;;)
    {
       bool dead_end = true;
-      for (auto con : map.at(pos).connections)
+      for (size_t i = 0; i < AROUND.size(); ++i)
       {
-         auto next = pos + con;
+         auto next = pos + AROUND[i];
          if (map.isConnected(pos, next))
          {
-            if (!track.empty() && track.back() == next)
+            if (length && prev == next)
                continue;
-            map.at(pos).visited = true;
-            track.emplace_back(pos);
+            map.cell(pos) |= VISITED;
+            area2 += long(pos.x) * next.y - long(next.x) * pos.y;
+            if (length++ == 1)
+               second = pos;
+            prev = pos;
             pos = next;
             dead_end = false;
             break;
@@ -148,71 +193,61 @@ int main(int argc, char* argv[])
    };
 
    map.dump();
-   fmt::println("A {} / 2 = {}", track.size(), track.size() / 2);
+   fmt::println("A {} / 2 = {}", length, length / 2);
 
+   //
+   // Pick's theorem: area = inside + boundary / 2 - 1, where the boundary points are the tiles
+   // of the loop. This needs neither a clean map nor another scan.
+   //
+   assert(pos == map.start);
+   auto enclosed = std::abs(area2) / 2 - long(length) / 2 + 1;
+   fmt::println("B {} (shoelace)", enclosed);
+
+#if 1
+   //
+   // Scan line algorithm, which rewrites the map for the picture. Disable for huge mazes.
    //
    // Clear out any garbage, i.e. any pipe symbols that are not part of the loop
    //
-   for (auto& row : map.map)
-      for (auto& cell : row)
-         if (!cell.visited)
-            cell = DOT;
+   for (auto& tile : map.tiles)
+      if (!(tile & VISITED))
+         tile = 0;
 
    //
-   // Replace 'S' with correct symbol, so scan line algorithm works:
+   // Replace 'S' with the pipe connecting the first and last tile of the track.
    //
-   for (auto& pipe : PIPES)
-   {
-      map.at(map.start) = pipe;
-      if (map.isConnected(map.start, track[1]) && map.isConnected(map.start, track.back()))
-         break;
-   }
+   map.cell(map.start) =
+      VISITED | START | Map::direction(map.start, second) | Map::direction(map.start, prev);
 
    //
    // Scan rows: Any encounter of '|', "┌┄┘" or "└┄┐" toggles the inside flag, and any encounter
    // of '.' while the flag is true means that the '.' is inside the loop.
    //
-   // This loop expectes the map to be 'clean', i.e. contain only the (closed) loop and '.'.
+   // With direction bits, this is the same as toggling on every tile that connects north: '│'
+   // does, "┌┄┘" and "└┄┐" have one such tile, and "┌┄┐" and "└┄┘" have none or two.
    //
    int count = 0;
-   for (auto& row : map.map)
+   for (int y = 0; y < map.h; ++y)
    {
       bool inside = false;
-      for (auto it = row.begin(); it != row.end(); ++it)
+      for (int x = 0; x < map.w; ++x)
       {
-         switch (it->symbol)
-         {
-         case '|':
+         auto& tile = map.cell({x, y});
+         if (tile & NORTH)
             inside = !inside;
-            break;
-
-         case '.':
-            if (inside)
-            {
-               *it = *PIPES.find('I');
-               count++;
-            }
-            break;
-
-         case 'F':
-         case 'L':
+         else if (!(tile & PIPE) && inside)
          {
-            auto start = *it++;
-            while (it->symbol == '-') // skip ┄
-               it++;
-            if (start.symbol == 'F' && it->symbol == 'J' || // ┌┄┘
-                start.symbol == 'L' && it->symbol == '7') // └┄┐
-               inside = !inside;
-         }
-         break;
-
-         default:
-            fmt::println("unexpected symbol '{}'", it->symbol);
-            assert(false);
+            tile |= INSIDE;
+            count++;
          }
       }
    }
 
    map.dump();
-   fmt::println("B {}", count);
+   fmt::println("B {} (scan line)", count);
+   assert(count == enclosed);
+#endif
+
+   if (argc > 2)
+      map.image().write(argv[2]);
 }
@@ -1,86 +1,74 @@
 //
 // https://adventofcode.com/2023/day/11
 //
-#include <set>
-
-#include <range/v3/algorithm/all_of.hpp>
-#include <range/v3/range/conversion.hpp>
-#include <range/v3/view/filter.hpp>
-#include <range/v3/view/iota.hpp>
-#include <range/v3/view/istream.hpp>
-#include <range/v3/view/transform.hpp>
-#include <range/v3/view/zip.hpp>
-using namespace ranges;
-using namespace ranges::views;
+#include <algorithm>
 
 #include "common.hpp"
 
-struct Coord
-{
-   long x = -1, y = -1;
-   auto operator<=>(const Coord& r) const = default;
-   Coord operator+(const Coord& r) const { return Coord{x + r.x, y + r.y}; }
-};
-
-long computeDistances(std::ifstream& file, long factor)
+//
+// Coordinates of all galaxies along one axis. Both axes can be solved independently, as the
+// Manhattan distance is the sum of the distances along x and y.
+//
+// With coordinates c[i] sorted, the sum over all pairs of |c[j] - c[i]| is the sum of
+// (2i - n + 1) * c[i]. After expansion, each coordinate becomes c[i] + (factor - 1) * e[i], where
+// e[i] is the number of empty lines before it. So the sum is affine in the expansion factor.
+//
+struct Axis
 {
-   assert(factor >= 1);
+   std::vector<long> coords;
+   long sum = 0; // sum of distances without expansion
+   long expansion = 0; // additional distance per unit of (factor - 1)
 
-   //
-   // parse input file, applying vertical expansion on the fly
-   //
-   std::set<Coord> galaxies;
+   void prepare()
    {
-      file.clear();
-      file.seekg(0);
-      std::string line;
-      for (int y = 0; std::getline(file, line); y++)
+      std::ranges::sort(coords);
+      const long n = coords.size();
+      long distinct = 0;
+      for (long i = 0; i < n; ++i)
       {
-         if (all_of(line, [](char c) { return c == '.'; }))
-            y += factor - 1;
-         else
-            for (auto galaxy : zip(line, iota(0)) | filter([](auto p) { return p.first == '#'; }) |
-                                  transform(
-                                     [&](auto p) {
-                                        return Coord{p.second, y};
-                                     }))
-               galaxies.insert(galaxy);
+         if (i == 0 || coords[i] != coords[i - 1])
+            ++distinct;
+         auto empty = coords[i] - (distinct - 1); // empty lines before coords[i]
+         sum += (2 * i - n + 1) * coords[i];
+         expansion += (2 * i - n + 1) * empty;
       }
    }
+};
 
-   //
-   // Apply horizontal expansion by going through used x-Coordinates from left to right.
-   // This works because Coords is using the default <=> operator, which imposes a lexicographical
-   // ordering on the [x, y] members.
-   //
-   std::set<Coord> expanded;
+struct Galaxies
+{
+   explicit Galaxies(std::ifstream file)
    {
-      long expansion = 0, last_x = galaxies.begin()->x;
-      for (auto it = galaxies.begin(); it != galaxies.end();)
-      {
-         expansion += std::max(0L, it->x - last_x - 1) * (factor - 1);
-         last_x = it->x;
-         while (it != galaxies.end() && it->x == last_x)
-            expanded.insert(*it++ + Coord{expansion, 0});
-      }
+      std::string line;
+      for (long y = 0; std::getline(file, line); y++)
+         for (long x = 0; x < long(line.size()); ++x)
+            if (line[x] == '#')
+            {
+               xs.coords.emplace_back(x);
+               ys.coords.emplace_back(y);
+            }
+
+      xs.prepare();
+      ys.prepare();
    }
 
-   //
-   // finally, sum distances, counting each pair only once
-   //
-   size_t sum = 0;
-   for (auto ia = expanded.begin(); ia != expanded.end(); ++ia)
-      for (auto ib = ia; ib != expanded.end(); ++ib)
-         sum += abs(ib->x - ia->x) + abs(ib->y - ia->y);
+   size_t size() const { return xs.coords.size(); }
 
-   return sum;
-}
+   long computeDistances(long factor) const
+   {
+      assert(factor >= 1);
+      return xs.sum + ys.sum + (factor - 1) * (xs.expansion + ys.expansion);
+   }
+
+   Axis xs, ys;
+};
 
 int main(int argc, char* argv[])
 {
-   auto file = input(argc, argv);
-   fmt::println("A: {}", computeDistances(file, 2));
-   fmt::println("B: {} (*10)", computeDistances(file, 10));
-   fmt::println("B: {} (*100)", computeDistances(file, 100));
-   fmt::println("B: {} (*1M)", computeDistances(file, 1'000'000));
-}
\ No newline at end of file
+   Galaxies galaxies(input(argc, argv));
+   fmt::println("{} galaxies", galaxies.size());
+   fmt::println("A: {}", galaxies.computeDistances(2));
+   fmt::println("B: {} (*10)", galaxies.computeDistances(10));
+   fmt::println("B: {} (*100)", galaxies.computeDistances(100));
+   fmt::println("B: {} (*1M)", galaxies.computeDistances(1'000'000));
+}
@@ -1,6 +1,9 @@
 //
 // https://adventofcode.com/2023/day/12
 //
+#include <cstdlib>
+#include <stdexcept>
+
 #include <range/v3/algorithm/all_of.hpp>
 #include <range/v3/range/conversion.hpp>
 #include <range/v3/view/filter.hpp>
@@ -20,89 +23,137 @@ using namespace ranges::views;
 
 constexpr auto to_number = transform([](auto s) { return std::stoi(s.str()); });
 
-size_t countVariants(std::string_view pattern, std::optional<int> n, std::span<int> groups)
+using Count = unsigned __int128;
+
+Count add(Count a, Count b)
+{
+   Count sum;
+   if (__builtin_add_overflow(a, b, &sum))
+      throw std::overflow_error("arrangement count exceeds 128 bits");
+   return sum;
+}
+
+//
+// Bit i is set if pattern[i] is one of 'chars'. Spans as many words as the row needs.
+//
+struct Mask
 {
-   // fmt::println("{:8} at {} [{}]", n, pattern, fmt::join(groups, ","));
+   Mask(std::string_view pattern, std::string_view chars) : words((pattern.size() + 63) / 64)
+   {
+      for (size_t i = 0; i < pattern.size(); ++i)
+         if (chars.find(pattern[i]) != std::string_view::npos)
+            words[i / 64] |= uint64_t{1} << (i % 64);
+   }
 
-   if (pattern.empty())
-      return (!n && groups.empty()) ? 1 : 0;
+   bool test(size_t i) const { return words[i / 64] >> (i % 64) & 1; }
 
-   switch (pattern[0])
+   // true if all bits in [i, i+n) are set
+   bool all(size_t i, size_t n) const
    {
-   default:
-      assert(false);
-
-   case '.':
-      if (!n || n == 0) // skip '.' if not within a group
-         return countVariants(pattern.substr(1), std::nullopt, groups);
-      else // '.' while still within a group: invalid
-         return 0;
-
-   case '#':
-      if (!n) // start a new group
-         return groups.empty() ? 0 : countVariants(pattern, groups[0], groups.subspan(1));
-      else if (n == 0) // group finished, but still a '#' left to fill
-         return 0;
-      else // continue with group
+      while (n)
       {
-         size_t i = 1;
-         while (pattern[i] == '#' && *n > 0)
-            ++i;
-         return countVariants(pattern.substr(i), *n - i, groups);
+         size_t bit = i % 64, k = std::min(n, 64 - bit);
+         uint64_t mask = (k == 64 ? ~uint64_t{0} : (uint64_t{1} << k) - 1) << bit;
+         if ((words[i / 64] & mask) != mask)
+            return false;
+         i += k, n -= k;
       }
+      return true;
+   }
+
+   std::vector<uint64_t> words;
+};
+
+//
+// Count arrangements by placing one group after the other. With f[g][p] being the number of
+// ways to place groups g.. into pattern[p..]:
+//
+//   f[g][p] = f[g][p+1]               if pattern[p] may be '.'
+//           + f[g+1][p+len+1]         if group g fits at p
+//
+// Group g fits at p if [p, p+len) contains only '#' or '?', and pattern[p+len] is not '#'.
+// Both are mask tests. Only two rows of f are needed, which are reused across lines.
+//
+class Arrangements
+{
+public:
+   Count count(std::string_view pattern, std::span<const int> groups)
+   {
+      const size_t n = pattern.size();
+      const Mask damaged(pattern, "#"), possible(pattern, "#?");
 
-   case '?':
-      if (!n)
-#if 0
+      // no groups left: valid if there are no more '#'
+      next.assign(n + 2, 0);
+      for (size_t pos = n + 1; pos-- > 0;)
+         next[pos] = pos >= n || (!damaged.test(pos) && next[pos + 1]);
+
+      for (size_t g = groups.size(); g-- > 0;)
       {
-         // ????? 2,1 == ???? 1,1
-         size_t i = 1;
-         while (pattern[i] == '?' && *n > 0)
-            ++i;
-         if (pattern[i] == '#')
-            --i;
-         return 0;
+         const size_t len = groups[g];
+         current.assign(n + 2, 0);
+         for (size_t pos = n; pos-- > 0;)
+         {
+            Count ways = damaged.test(pos) ? 0 : current[pos + 1];
+            if (pos + len <= n && possible.all(pos, len) &&
+                (pos + len == n || !damaged.test(pos + len)))
+               ways = add(ways, next[std::min(pos + len + 1, n)]);
+            current[pos] = ways;
+         }
+         std::swap(current, next);
       }
-#else
-         return
-            // treat '?' as '.' and skip it
-            countVariants(pattern.substr(1), std::nullopt, groups) +
-            // treat '?' as '#' and start a group
-            (groups.empty() ? 0 : countVariants(pattern, groups[0], groups.subspan(1)));
-#endif
-      else if (n == 0) // treat as '.' and finish group
-         return countVariants(pattern.substr(1), std::nullopt, groups);
-      else // treat as '#' and continue with group
-         return countVariants(pattern.substr(1), *n - 1, groups);
+      return next[0];
    }
-}
+
+private:
+   std::vector<Count> current, next;
+};
 
 int main(int argc, char* argv[])
 {
    auto file = input(argc, argv);
+   const size_t unfold = argc > 2 ? std::stoi(argv[2]) : 5;
 
-   size_t A = 0, B = 0;
+   Count A = 0, B = 0;
+   size_t overflows = 0;
+   Arrangements arrangements;
    const boost::regex regexp{R"(([.#?]+) (?:(\d+),?)*)"};
-   for (std::string line; std::getline(file, line) && !line.empty();)
+   size_t number = 1;
+   for (std::string line; std::getline(file, line) && !line.empty(); ++number)
    {
       boost::smatch what;
       boost::regex_match(line, what, regexp, boost::match_extra | boost::match_perl);
 
       auto pattern = what[1].str();
       auto groups = what[2].captures() | to_number | to<std::vector>;
-      auto count = countVariants(pattern + '.', std::nullopt, groups);
+      auto count = arrangements.count(pattern, groups);
       fmt::println("{} {} -> {}", pattern, fmt::join(groups, ","), count);
-      A += count;
-      continue;
+      A = add(A, count);
 
-      pattern = repeat_n(what[1].str(), 5) | join('?') | to<std::string>;
-      groups = repeat_n(what[2].captures() | to_number, 5) | join | to<std::vector>;
-      fmt::println("{} {}", pattern, fmt::join(groups, ","));
-      count = countVariants(pattern + '.', std::nullopt, groups);
-      fmt::println("{} {} -> {}", pattern, fmt::join(groups, ","), count);
-      B += count;
+      //
+      // Large unfold factors overflow even 128 bits. Report the line and go on with the others,
+      // so part A and the remaining lines are still checked.
+      //
+      try
+      {
+         auto unfolded = repeat_n(pattern, unfold) | join('?') | to<std::string>;
+         auto unfolded_groups = repeat_n(groups, unfold) | join | to<std::vector>;
+         count = arrangements.count(unfolded, unfolded_groups);
+         fmt::println("{} {} x{} -> {}", pattern, fmt::join(groups, ","), unfold, count);
+         B = add(B, count);
+      }
+      catch (const std::overflow_error& e)
+      {
+         fmt::print(stderr, "line {}: {} {} x{}: {}\n", number, pattern, fmt::join(groups, ","),
+                    unfold, e.what());
+         ++overflows;
+      }
    }
 
    fmt::println("A: {}", A);
-   fmt::println("B: {}", B);
+   if (overflows)
+   {
+      fmt::println("B: overflow in {} line(s) (x{})", overflows, unfold);
+      return EXIT_FAILURE;
+   }
+   fmt::println("B: {} (x{})", B, unfold);
 }
\ No newline at end of file
@@ -1,52 +1,177 @@
 //
 // https://adventofcode.com/2023/day/13
 //
-#include <range/v3/algorithm/all_of.hpp>
-#include <range/v3/range/conversion.hpp>
-#include <range/v3/view/iota.hpp>
-#include <range/v3/view/transform.hpp>
-#include <range/v3/view/zip.hpp>
-using namespace ranges;
-using namespace ranges::views;
+#include <bit>
+#include <span>
+#include <thread>
 
 #include "common.hpp"
 
-int findReflection(const std::vector<std::string>& vec, const int allowed_smudges)
+//
+// A pattern as read, its rows back to back.
+//
+struct Pattern
+{
+   std::string cells;
+   size_t w = 0, h = 0;
+
+   bool empty() const { return h == 0; }
+
+   void clear()
+   {
+      cells.clear();
+      w = h = 0;
+   }
+
+   void add(std::string_view row)
+   {
+      assert(h == 0 || w == row.size());
+      w = row.size();
+      cells.append(row);
+      ++h;
+   }
+
+   GridView<const char> grid() const { return GridView<const char>::flat(cells.data(), w, h); }
+};
+
+//
+// One bitmask per row of a view, with '#' being a set bit. Patterns are narrow, so a row fits into
+// 64 bits. The columns are the rows of the transposed view.
+//
+void appendMasks(GridView<const char> view, std::vector<uint64_t>& masks)
 {
-   for (int pos = 1; pos < vec.size(); ++pos)
+   assert(view.width() <= 64);
+   for (auto row : view)
    {
-      int a = pos - 1, b = pos, smudges = allowed_smudges;
-      while (a >= 0 && b < vec.size() &&
-             ranges::all_of(zip(vec[a], vec[b]),
-                            [&](const auto& p) { return p.first == p.second || smudges-- > 0; }))
-         --a, ++b;
+      uint64_t mask = 0;
+      for (size_t x = 0; x < row.size(); ++x)
+         if (row[x] == '#')
+            mask |= uint64_t{1} << x;
+      masks.emplace_back(mask);
+   }
+}
 
-      // this is a match only if EXACTLY the required numbers of smudges have been used
-      if ((a == -1 || b == vec.size()) && smudges == 0)
+//
+// The number of differing cells between two lines is the popcount of their XOR. This is a match
+// only if EXACTLY the required number of smudges is found, so stop comparing once there are more.
+//
+int findReflection(std::span<const uint64_t> lines, const int smudges)
+{
+   for (int pos = 1; pos < std::ssize(lines); ++pos)
+   {
+      int diff = 0;
+      for (int a = pos - 1, b = pos; a >= 0 && b < std::ssize(lines) && diff <= smudges; --a, ++b)
+         diff += std::popcount(lines[a] ^ lines[b]);
+
+      if (diff == smudges)
          return pos;
    }
 
    return 0; // no mirror found
 }
 
-int main(int argc, char* argv[])
+// -------------------------------------------------------------------------------------------------
+
+//
+// Many patterns back to back in one arena, each one being its rows followed by its columns.
+//
+struct Arena
 {
-   auto file = input(argc, argv);
+   struct Extent
+   {
+      size_t offset;
+      uint32_t h, w;
+   };
+
+   std::vector<uint64_t> words;
+   std::vector<Extent> patterns;
+
+   size_t size() const { return patterns.size(); }
+   std::span<const uint64_t> rows(const Extent& e) const { return {words.data() + e.offset, e.h}; }
+   std::span<const uint64_t> columns(const Extent& e) const
+   {
+      return {words.data() + e.offset + e.h, e.w};
+   }
+
+   // read up to 'count' patterns, returns false if there are none left
+   bool read(std::ifstream& file, size_t count)
+   {
+      words.clear();
+      patterns.clear();
 
+      Pattern pattern;
+      while (size() < count && !file.eof())
+      {
+         pattern.clear();
+         for (std::string row; std::getline(file, row) && !row.empty();)
+            pattern.add(row);
+
+         if (pattern.empty())
+            continue;
+
+         patterns.emplace_back(words.size(), pattern.h, pattern.w);
+         appendMasks(pattern.grid(), words);
+         appendMasks(pattern.grid().transpose(), words);
+      }
+      return !patterns.empty();
+   }
+};
+
+struct Result
+{
    size_t A = 0, B = 0;
-   while (!file.eof())
+};
+
+//
+// Split the patterns of an arena into contiguous chunks, one per worker thread. Each worker
+// reduces A and B locally, which are summed up after joining.
+//
+Result process(const Arena& arena, size_t threads)
+{
+   std::vector<Result> results(threads);
+   std::vector<std::thread> workers;
+   for (size_t t = 0; t < threads; ++t)
+      workers.emplace_back(
+         [&, t]
+         {
+            Result local;
+            auto begin = arena.size() * t / threads, end = arena.size() * (t + 1) / threads;
+            for (auto i = begin; i < end; ++i)
+            {
+               auto rows = arena.rows(arena.patterns[i]);
+               auto columns = arena.columns(arena.patterns[i]);
+               local.A += findReflection(columns, 0) + 100 * findReflection(rows, 0);
+               local.B += findReflection(columns, 1) + 100 * findReflection(rows, 1);
+            }
+            results[t] = local;
+         });
+
+   Result result;
+   for (size_t t = 0; t < threads; ++t)
    {
-      std::vector<std::string> rows;
-      for (std::string row; std::getline(file, row) && !row.empty();)
-         rows.emplace_back(row);
+      workers[t].join();
+      result.A += results[t].A;
+      result.B += results[t].B;
+   }
+   return result;
+}
 
-      std::vector<std::string> columns;
-      for (size_t i = 0; i < rows[0].size(); ++i)
-         columns.emplace_back(rows | transform([&](auto& str) { return str[i]; }) |
-                              to<std::string>);
+// -------------------------------------------------------------------------------------------------
 
-      A += findReflection(columns, 0) + 100 * findReflection(rows, 0);
-      B += findReflection(columns, 1) + 100 * findReflection(rows, 1);
+int main(int argc, char* argv[])
+{
+   auto file = input(argc, argv);
+
+   const size_t BATCH = 1 << 16; // patterns per arena fill
+   const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+
+   Arena arena;
+   size_t A = 0, B = 0;
+   while (arena.read(file, BATCH))
+   {
+      auto result = process(arena, std::min(threads, arena.size()));
+      A += result.A;
+      B += result.B;
    }
 
    fmt::println("A: {}", A);
@@ -1,7 +1,13 @@
 //
 // https://adventofcode.com/2023/day/13
 //
-#include <set>
+#include <algorithm>
+#include <barrier>
+#include <bit>
+#include <functional>
+#include <optional>
+#include <thread>
+#include <unordered_map>
 
 #include <range/v3/algorithm/all_of.hpp>
 #include <range/v3/numeric/accumulate.hpp>
@@ -17,136 +23,113 @@ using namespace ranges;
 using namespace ranges::views;
 
 #include "common.hpp"
+#include "frame.hpp"
 
 // -------------------------------------------------------------------------------------------------
 
-struct ColumnIterator
+// bit mixer of splitmix64
+constexpr uint64_t mix(uint64_t x)
 {
-   char* p = nullptr;
-   ssize_t d = 0;
-
-   using value_type = char;
-   using difference_type = std::ptrdiff_t;
-
-   char& operator*() const { return *p; }
-   ColumnIterator& operator++()
-   {
-      p += d;
-      return *this;
-   }
-
-   ColumnIterator& operator--()
-   {
-      p -= d;
-      return *this;
-   }
-
-   ColumnIterator operator++(int) // NOLINT(cert-dcl21-cpp)
-   {
-      ColumnIterator temp = *this;
-      p += d;
-      return temp;
-   }
-
-   ColumnIterator operator--(int) // NOLINT(cert-dcl21-cpp)
-   {
-      ColumnIterator temp = *this;
-      p -= d;
-      return temp;
-   }
-
-   bool operator==(const ColumnIterator& other) const { return p == other.p; }
-   difference_type operator-(const ColumnIterator& other) const { return (p - other.p) / d; }
-};
-
-static_assert(std::forward_iterator<ColumnIterator>);
-static_assert(std::bidirectional_iterator<ColumnIterator>);
-
-// -------------------------------------------------------------------------------------------------
+   x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9;
+   x = (x ^ (x >> 27)) * 0x94d049bb133111eb;
+   return x ^ (x >> 31);
+}
 
-struct Row
+//
+// Zobrist hash of the positions of all round rocks: The hash is the XOR of the keys of all cells
+// holding a round rock. Moving a rock XORs out the key of its old cell and XORs in the key of the
+// new one. Instead of a table of random keys, the key of a cell is its mixed index, which is just
+// as well distributed and costs no memory. mix(0) is 0, hence the +1.
+//
+constexpr uint64_t zobrist(size_t index)
 {
-   char* p0;
-   ssize_t dx = 0; // offset to next column
-   size_t w;
+   return mix(index + 1);
+}
 
-   size_t size() const { return w; }
-   auto begin() const { return ColumnIterator{p0, dx}; }
-   auto end() const { return ColumnIterator{p0 + dx * w, dx}; }
+// -------------------------------------------------------------------------------------------------
 
-   size_t weight()
-   {
-      return accumulate(zip(reverse(*this), iota(1)) |
-                           filter([](auto a) { return a.first == 'O'; }) |
-                           transform([](auto a) { return a.second; }),
-                        size_t{0});
-   }
+//
+// The rows of a view are sliding towards their first cell. Tilting in any direction is sliding
+// the rows of a rotated view of the map.
+//
+using Row = GridRow<char>;
+using View = GridView<char>;
 
-   void slide();
-};
+// range-v3 has its own opt-in for borrowed ranges
+template <typename T>
+inline constexpr bool ranges::enable_borrowed_range<GridRow<T>> = true;
+template <typename T>
+inline constexpr bool ranges::enable_borrowed_range<GridView<T>> = true;
 
-static_assert(std::ranges::range<Row>);
-static_assert(ranges::range<Row>);
-static_assert(ranges::input_range<Row>);
-static_assert(ranges::forward_range<Row>);
+static_assert(ranges::random_access_range<Row>);
 static_assert(ranges::common_range<Row>); // if begin() and end() return the same type
-
-template <>
-inline constexpr bool ranges::enable_borrowed_range<Row> = true;
-static_assert(ranges::borrowed_range<Row>);
 static_assert(ranges::viewable_range<Row>);
+static_assert(ranges::random_access_range<View>);
+static_assert(ranges::viewable_range<View>);
 
-// -------------------------------------------------------------------------------------------------
-
-struct RowIterator
+// the first cell of a row weighs w, the last one weighs 1
+size_t rowWeight(Row row)
 {
-   Row row;
-   ssize_t dy = 0; // offset to next row
+   return accumulate(zip(reverse(row), iota(1)) | filter([](auto a) { return a.first == 'O'; }) |
+                        transform([](auto a) { return a.second; }),
+                     size_t{0});
+}
+
+// calls move(from, to) for every rock that moves
+template <typename Move>
+void slideRow(Row row, Move&& move);
 
-   using value_type = Row;
-   using difference_type = std::ptrdiff_t;
+// -------------------------------------------------------------------------------------------------
 
-   Row operator*() const { return row; }
-   RowIterator& operator++()
+//
+// Persistent worker threads for data parallel loops: run(job) calls job(t) for every thread t,
+// with the calling thread being t = 0, and returns when all of them are done. Workers wait on a
+// barrier between jobs, so there is no thread creation per job.
+//
+class Pool
+{
+public:
+   explicit Pool(size_t threads) : start(threads), done(threads)
    {
-      row.p0 += dy;
-      return *this;
+      for (size_t t = 1; t < threads; ++t)
+         workers.emplace_back(
+            [this, t]
+            {
+               for (;;)
+               {
+                  start.arrive_and_wait();
+                  if (!job)
+                     return;
+                  job(t);
+                  done.arrive_and_wait();
+               }
+            });
    }
-   RowIterator operator++(int) // NOLINT(cert-dcl21-cpp)
+
+   ~Pool()
    {
-      RowIterator temp = *this;
-      row.p0 += dy;
-      return temp;
+      job = nullptr; // tells workers to quit
+      start.arrive_and_wait();
+      for (auto& worker : workers)
+         worker.join();
    }
 
-   bool operator==(const RowIterator& other) const { return row.p0 == other.row.p0; }
-};
-
-static_assert(std::forward_iterator<RowIterator>);
-static_assert(!std::bidirectional_iterator<RowIterator>);
+   size_t size() const { return workers.size() + 1; }
 
-struct View
-{
-   char* p0;
-   const ssize_t dy, dx; // delta within view to go to next row / column
-   const size_t w, h;
+   void run(std::function<void(size_t)> f)
+   {
+      job = std::move(f);
+      start.arrive_and_wait();
+      job(0);
+      done.arrive_and_wait();
+   }
 
-   Row row(int r) const { return Row{p0 + r * dy, dx, w}; }
-   RowIterator begin() const { return {row(0), dy}; }
-   RowIterator end() const { return {row(h), dy}; }
+private:
+   std::barrier<> start, done;
+   std::function<void(size_t)> job;
+   std::vector<std::thread> workers;
 };
 
-static_assert(std::ranges::range<View>);
-static_assert(ranges::range<View>);
-static_assert(ranges::input_range<View>);
-static_assert(ranges::forward_range<View>);
-static_assert(ranges::common_range<View>);
-
-template <>
-inline constexpr bool ranges::enable_borrowed_range<View> = true;
-static_assert(ranges::borrowed_range<View>);
-static_assert(ranges::viewable_range<View>);
-
 // -------------------------------------------------------------------------------------------------
 
 enum class Direction : int
@@ -172,55 +155,490 @@ struct Map
 
    View view(Direction dir)
    {
+      auto grid = View::flat(pos(0, 0), w, h, dy);
       switch (dir)
       {
-         // clang-format off
       case Direction::west:
-         return View{pos(  0,   0), delta( 0,  1), delta( 1,  0), w, h};
+         return grid;
       case Direction::north:
-         return View{pos(w-1,   0), delta(-1,  0), delta( 0,  1), h, w};
+         return grid.rotateLeft();
       case Direction::east:
-         return View{pos(w-1, h-1), delta( 0, -1), delta(-1,  0), w, h};
+         return grid.rotateLeft().rotateLeft();
       case Direction::south:
-         return View{pos(  0, h-1), delta( 1,  0), delta( 0, -1), h, w};
-         // clang-format on
+         return grid.rotateRight();
       }
    }
 
-   size_t hash() const
+   //
+   // The hash, the compact state and the north weight are maintained incrementally while sliding.
+   // Call rehash() after modifying the map directly, which computes them from scratch.
+   //
+   size_t hash() const { return m_hash; }
+
+   void rehash()
+   {
+      m_hash = 0;
+      m_rocks.assign(h * words, 0);
+      m_weight = 0;
+      for (size_t y = 0; y < h; ++y)
+         for (size_t x = 0; x < w; ++x)
+            if (at(x, y) == 'O')
+            {
+               m_hash ^= zobrist(y * w + x);
+               m_rocks[y * words + x / 64] ^= uint64_t{1} << (x % 64);
+               m_weight += h - y;
+            }
+   }
+
+   // compact state: one bit per cell, set for round rocks, [y * words + x / 64]
+   const std::vector<uint64_t>& rocks() const { return m_rocks; }
+
+   //
+   // Changes of one share of a slide. A rock moving from row y0 to row y1 changes the north weight
+   // by y0 - y1.
+   //
+   struct Delta
+   {
+      uint64_t hash = 0;
+      ssize_t weight = 0;
+   };
+
+   void move(size_t x0, size_t y0, size_t x1, size_t y1, Delta& delta)
    {
-      return std::hash<std::string_view>{}(std::string_view(m_data.data(), m_data.size()));
+      delta.hash ^= zobrist(y0 * w + x0) ^ zobrist(y1 * w + x1);
+      delta.weight += ssize_t(y0) - ssize_t(y1);
+      m_rocks[y0 * words + x0 / 64] ^= uint64_t{1} << (x0 % 64);
+      m_rocks[y1 * words + x1 / 64] ^= uint64_t{1} << (x1 % 64);
    }
 
+   //
+   // Rows of a west/east tilt and columns of a north/south tilt are independent, so with a pool,
+   // each thread takes a contiguous share of them. Column shares are whole words of the rock bits,
+   // so no two threads write the same word. Each share returns its Delta, which are combined after
+   // the pool is done. As run() waits for all threads, consecutive slides are separated by a
+   // barrier.
+   //
    void slide(Direction dir)
    {
-      for (auto row : view(dir))
-         row.slide();
+      const size_t threads = pool ? pool->size() : 1;
+      const bool vertical = dir == Direction::north || dir == Direction::south;
+      auto share = [&](size_t t)
+      {
+         if (!vertical)
+         {
+            const bool west = dir == Direction::west;
+            auto v = view(dir);
+            Delta delta;
+            for (size_t r = v.h * t / threads, end = v.h * (t + 1) / threads; r < end; ++r)
+            {
+               const size_t y = west ? r : h - 1 - r;
+               const char* row = pos(0, y);
+               slideRow(v.row(r), [&](const char* from, const char* to)
+                        { move(from - row, y, to - row, y, delta); });
+            }
+            return delta;
+         }
+         auto column = [&](size_t t) { return std::min(w, words * t / threads * 64); };
+         return slideVertical(dir == Direction::north, column(t), column(t + 1));
+      };
+
+      std::vector<Delta> deltas(threads);
+      if (pool)
+         pool->run([&](size_t t) { deltas[t] = share(t); });
+      else
+         deltas[0] = share(0);
+
+      for (auto delta : deltas)
+         m_hash ^= delta.hash, m_weight += delta.weight;
    }
 
+   //
+   // North and south tilts: Walking a column has a stride of dy, touching a new cache line on
+   // every step. Instead, sweep row by row over blocks of BLOCK columns, keeping the next free row
+   // of each column. Within a row, all accesses are contiguous, as with the west tilt.
+   //
+   Delta slideVertical(bool north, size_t x_begin, size_t x_end)
+   {
+      constexpr size_t BLOCK = 256;
+      std::array<ssize_t, BLOCK> free;
+      const ssize_t first = north ? 0 : h - 1, step = north ? 1 : -1;
+      Delta delta;
+      for (size_t x0 = x_begin; x0 < x_end; x0 += BLOCK)
+      {
+         const size_t n = std::min(BLOCK, x_end - x0);
+         free.fill(first);
+         for (ssize_t y = first; y >= 0 && y < ssize_t(h); y += step)
+         {
+            char* row = pos(x0, y);
+            for (size_t x = 0; x < n; ++x)
+            {
+               if (row[x] == '#')
+                  free[x] = y + step;
+               else if (row[x] == 'O')
+               {
+                  if (free[x] != y)
+                  {
+                     row[x] = '.', at(x0 + x, free[x]) = 'O';
+                     move(x0 + x, y, x0 + x, free[x], delta);
+                  }
+                  free[x] += step;
+               }
+            }
+         }
+      }
+      return delta;
+   }
+
+   void cycle()
+   {
+      for (auto dir : {Direction::north, Direction::west, Direction::south, Direction::east})
+         slide(dir);
+   }
+
+   size_t weight() const { return m_weight; }
+
    size_t weight(Direction dir)
    {
-      return accumulate(view(dir) | transform(&Row::weight), size_t{0});
+      return accumulate(view(dir) | transform(rowWeight), size_t{0});
    }
 
    void dump(Direction direction = Direction::west)
    {
+      auto& frame = screen();
       for (auto row : view(direction))
-         fmt::println("{}", fmt::join(row, ""));
-      fmt::println("");
+      {
+         for (char c : row)
+            frame.append(c);
+         frame.newline();
+      }
+      frame.newline();
+      frame.flush();
+   }
+
+   Image image()
+   {
+      Image image(w, h);
+      for (size_t y = 0; y < h; ++y)
+         for (size_t x = 0; x < w; ++x)
+            switch (at(x, y))
+            {
+            case 'O':
+               image.set(x, y, {255, 255, 255});
+               break;
+            case '#':
+               image.set(x, y, {96, 96, 96});
+               break;
+            }
+      return image;
    }
 
    const size_t w, h, dy;
+   const size_t words = (w + 63) / 64; // per row of m_rocks
    std::vector<char> m_data;
+   uint64_t m_hash = 0;
+   std::vector<uint64_t> m_rocks;
+   size_t m_weight = 0;
+   Pool* pool = nullptr; // slide in parallel if set
+};
+
+// -------------------------------------------------------------------------------------------------
+
+//
+// Bitboard representation of the dish: round and cube rocks as bit planes, one bit per cell.
+//
+// A tilt works on the segments between cube rocks: count the round rocks within each segment
+// with popcount, clear it and fill it from the respective end. Segments are contiguous along the
+// lines of a plane, so there are two planes, rows for west/east and columns for north/south.
+// After a tilt, the round rocks of the other plane are brought up to date by transposing 64x64
+// blocks. So each tilt costs O(cells / 64 + segments), however the rocks are stacked.
+//
+// The hash and the north weight belong to the row plane. Its words are rewritten by west/east
+// tilts and by the transposes after north/south tilts, and both report each word that changed,
+// so keeping them up to date costs O(changed words), which is at most O(moved rocks).
+//
+// With the pool of the map, lines of a tilt and 64-line blocks of a transpose are split into
+// contiguous shares, as with Map::slide. Both write whole words of their own lines, so shares
+// never write the same word.
+//
+class Bitboard
+{
+public:
+   explicit Bitboard(Map& map) : pool(map.pool), w(map.w), h(map.h), rows(h, w), columns(w, h)
+   {
+      for (size_t y = 0; y < h; ++y)
+         for (size_t x = 0; x < w; ++x)
+            if (map.at(x, y) == 'O')
+               rows.set(rows.round, y, x), columns.set(columns.round, x, y);
+            else if (map.at(x, y) == '#')
+               rows.set(rows.cube, y, x), columns.set(columns.cube, x, y);
+
+      Delta delta;
+      for (size_t i = 0; i < rows.round.size(); ++i)
+         changed(delta, rows, i, 0, rows.round[i]);
+      m_hash = delta.hash, m_weight = delta.weight;
+   }
+
+   void tilt(Direction dir)
+   {
+      const bool vertical = dir == Direction::north || dir == Direction::south;
+      auto& plane = vertical ? columns : rows;
+      auto& other = vertical ? rows : columns;
+      const bool toEnd = dir == Direction::south || dir == Direction::east;
+
+      run(
+         [&](size_t t, size_t threads, Delta& delta)
+         {
+            plane.tilt(toEnd, plane.lines * t / threads, plane.lines * (t + 1) / threads,
+                       [&](size_t i, uint64_t old, uint64_t now)
+                       { changed(delta, plane, i, old, now); });
+         });
+
+      // one barrier between the tilt and the transpose, which reads all lines of the plane
+      const size_t blocks = (plane.lines + 63) / 64;
+      run(
+         [&](size_t t, size_t threads, Delta& delta)
+         {
+            transpose(plane, other, blocks * t / threads, blocks * (t + 1) / threads,
+                      [&](size_t i, uint64_t old, uint64_t now)
+                      { changed(delta, other, i, old, now); });
+         });
+   }
+
+   void cycle()
+   {
+      for (auto dir : {Direction::north, Direction::west, Direction::south, Direction::east})
+         tilt(dir);
+   }
+
+   // each round rock in row y counts h - y
+   size_t weight() const { return m_weight; }
+
+   // the round rocks are their own compact state: [y * words + x / 64]
+   const std::vector<uint64_t>& rocks() const { return rows.round; }
+
+   size_t hash() const { return m_hash; }
+
+   // writes the round rocks back to the map
+   void store(Map& map) const
+   {
+      for (size_t y = 0; y < h; ++y)
+         for (size_t x = 0; x < w; ++x)
+            if (map.at(x, y) != '#')
+               map.at(x, y) = rows.round[y * rows.words + x / 64] >> (x % 64) & 1 ? 'O' : '.';
+      map.rehash();
+      assert(map.weight() == m_weight);
+   }
+
+   Pool* pool = nullptr; // tilt in parallel if set
+
+private:
+   // changes of one share, the weight modulo 2^64 as it may go down
+   struct Delta
+   {
+      uint64_t hash = 0;
+      size_t weight = 0;
+   };
+
+   // runs job(t, threads, delta) for every share and applies their deltas
+   template <typename Job>
+   void run(Job&& job)
+   {
+      const size_t threads = pool ? pool->size() : 1;
+      std::vector<Delta> deltas(threads);
+      if (pool)
+         pool->run([&](size_t t) { job(t, threads, deltas[t]); });
+      else
+         job(0, 1, deltas[0]);
+
+      for (auto delta : deltas)
+         m_hash ^= delta.hash, m_weight += delta.weight;
+   }
+
+
+   struct Plane
+   {
+      Plane(size_t lines, size_t length)
+         : lines(lines), length(length), words((length + 63) / 64), round(lines * words),
+           cube(lines * words)
+      {
+      }
+
+      void set(std::vector<uint64_t>& bits, size_t line, size_t pos)
+      {
+         bits[line * words + pos / 64] |= uint64_t{1} << (pos % 64);
+      }
+
+      // position of the first cube rock at or after 'a' in 'line', or length
+      size_t nextCube(size_t line, size_t a) const
+      {
+         for (size_t i = a / 64; i < words; ++i)
+            if (auto bits = cube[line * words + i] & (~uint64_t{0} << (i == a / 64 ? a % 64 : 0)))
+               return std::min(length, i * 64 + std::countr_zero(bits));
+         return length;
+      }
+
+      // tilts lines [begin, end), calls changed(index, old, now) for every word that changed
+      template <typename Changed>
+      void tilt(bool toEnd, size_t begin, size_t end, Changed&& changed)
+      {
+         std::vector<uint64_t> old(words);
+         for (size_t line = begin; line < end; ++line)
+         {
+            auto* bits = &round[line * words];
+            std::copy_n(bits, words, old.begin());
+            for (size_t a = 0, b; a < length; a = b + 1)
+            {
+               b = nextCube(line, a);
+               int count = 0;
+               span(a, b, [&](size_t i, uint64_t mask) { count += std::popcount(bits[i] & mask); });
+               span(a, b, [&](size_t i, uint64_t mask) { bits[i] &= ~mask; });
+               if (toEnd)
+                  span(b - count, b, [&](size_t i, uint64_t mask) { bits[i] |= mask; });
+               else
+                  span(a, a + count, [&](size_t i, uint64_t mask) { bits[i] |= mask; });
+            }
+            for (size_t i = 0; i < words; ++i)
+               if (bits[i] != old[i])
+                  changed(line * words + i, old[i], bits[i]);
+         }
+      }
+
+      const size_t lines, length, words;
+      std::vector<uint64_t> round, cube; // [line * words + pos / 64]
+   };
+
+   //
+   // Word i of a plane changed from old to now, only the row plane counts. The hash is the XOR of
+   // the keys of all words, relative to an empty plane, where the key of a word is its value mixed
+   // with its index. So a change XORs out the old key and XORs in the new one.
+   //
+   void changed(Delta& delta, const Plane& plane, size_t i, uint64_t old, uint64_t now) const
+   {
+      if (&plane != &rows)
+         return;
+      const size_t weight = h - i / rows.words;
+      delta.hash ^= mix(old ^ zobrist(i)) ^ mix(now ^ zobrist(i));
+      delta.weight -= weight * std::popcount(old);
+      delta.weight += weight * std::popcount(now);
+   }
+
+   // calls f(word, mask) for each word covering bits [a, b)
+   template <typename F>
+   static void span(size_t a, size_t b, F&& f)
+   {
+      while (a < b)
+      {
+         size_t bit = a % 64, n = std::min(b - a, 64 - bit);
+         f(a / 64, (n == 64 ? ~uint64_t{0} : (uint64_t{1} << n) - 1) << bit);
+         a += n;
+      }
+   }
+
+   // in place: bit j of block[i] becomes bit i of block[j]
+   static void transpose64(std::array<uint64_t, 64>& block)
+   {
+      uint64_t m = 0x00000000ffffffff;
+      for (int j = 32; j != 0; j >>= 1, m ^= m << j)
+         for (int k = 0; k < 64; k = (k + j + 1) & ~j)
+         {
+            uint64_t t = ((block[k] >> j) ^ block[k + j]) & m;
+            block[k + j] ^= t;
+            block[k] ^= t << j;
+         }
+   }
+
+   //
+   // Round rocks of 'to' from those of 'from', where lines of one are positions of the other, for
+   // 64-line blocks [begin, end) of 'from'. Calls changed(index, old, now) for every word of 'to'
+   // that changed.
+   //
+   template <typename Changed>
+   static void transpose(const Plane& from, Plane& to, size_t begin, size_t end, Changed&& changed)
+   {
+      std::array<uint64_t, 64> block;
+      for (size_t l0 = begin * 64; l0 < std::min(end * 64, from.lines); l0 += 64)
+         for (size_t i = 0; i < from.words; ++i)
+         {
+            for (size_t k = 0; k < 64; ++k)
+               block[k] = l0 + k < from.lines ? from.round[(l0 + k) * from.words + i] : 0;
+            transpose64(block);
+            for (size_t k = 0; k < 64 && i * 64 + k < to.lines; ++k)
+            {
+               auto& word = to.round[(i * 64 + k) * to.words + l0 / 64];
+               if (word != block[k])
+                  changed(&word - to.round.data(), word, block[k]), word = block[k];
+            }
+         }
+   }
+
+   const size_t w, h;
+   Plane rows, columns;
+   uint64_t m_hash = 0;
+   size_t m_weight = 0;
+};
+
+// -------------------------------------------------------------------------------------------------
+
+//
+// Part B: perform 1G cycles -- which takes forever, but there are loops. Detect by hashing, and
+// confirm each hash match against a compact copy of the state, so a hash collision cannot lead
+// to a wrong loop. With the north weight recorded for every cycle, the weight after any number of
+// cycles is a lookup.
+//
+// An engine provides cycle(), hash(), rocks() as its compact state and weight() to the north.
+//
+struct Loop
+{
+   size_t t0 = 0, size = 0;
+   std::vector<size_t> weights; // north weight after cycle i + 1
+
+   size_t weightAfter(size_t cycles) const
+   {
+      assert(cycles >= 1);
+      if (cycles <= t0)
+         return weights[cycles - 1];
+      return weights[t0 - 1 + (cycles - t0) % size];
+   }
 };
 
+template <typename Engine>
+Loop findLoop(Engine& engine)
+{
+   Loop loop;
+   std::unordered_multimap<size_t, size_t> seen; // hash -> index into states
+   std::vector<std::vector<uint64_t>> states; // state after cycle i + 1
+   for (size_t cycle = 1; !loop.size; ++cycle)
+   {
+      engine.cycle();
+
+      const auto hash = engine.hash();
+      const auto& state = engine.rocks();
+      for (auto [it, end] = seen.equal_range(hash); it != end && !loop.size; ++it)
+      {
+         if (states[it->second] == state)
+         {
+            loop.t0 = it->second + 1;
+            loop.size = cycle - loop.t0;
+         }
+         else
+            fmt::println("hash collision at cycle {}", cycle);
+      }
+
+      seen.emplace(hash, states.size());
+      states.emplace_back(state);
+      loop.weights.emplace_back(engine.weight());
+   }
+   return loop;
+}
+
 //
 // This implementation relies on a non-[.#O]-border around the map, avoiding a lot of checks
 // against vec.end().
 //
-void Row::slide()
+template <typename Move>
+void slideRow(Row row, Move&& move)
 {
-   for (auto p0 = begin(); p0 != end();)
+   for (auto p0 = row.begin(); p0 != row.end();)
    {
       //
       //    OO.O.O..#.O
@@ -243,7 +661,10 @@ void Row::slide()
       // p1    ^
       //
       while (*p1 == 'O')
+      {
+         move(&*p1, &*p0);
          *p0++ = 'O', *p1++ = '.';
+      }
 
       if (*p1 != '.')
          p0 = p1;
@@ -271,6 +692,19 @@ int main(int argc, char* argv[])
       assert(rows[i].size() == w);
       memcpy(map.pos(0, i), rows[i].data(), w);
    }
+   map.rehash();
+
+   //
+   // Threads only pay off on large dishes: for the puzzle input, a slide or tilt takes a few
+   // microseconds, which is about the cost of the barrier.
+   //
+   const size_t PARALLEL = 1 << 18; // cells
+   std::optional<Pool> pool;
+   if (w * h >= PARALLEL)
+   {
+      pool.emplace(std::max(1u, std::thread::hardware_concurrency()));
+      map.pool = &*pool;
+   }
 
    //
    // part A: slide north once
@@ -279,45 +713,58 @@ int main(int argc, char* argv[])
 
    // dump(map);
 
-   size_t A = map.weight(Direction::north);
+   size_t A = map.weight();
    fmt::println("A: {}", A);
 
+   const size_t CYCLES = 1'000'000'000;
+
    //
-   // part B: perforam 1M cycles -- which takes forever, but there are loops. Detect by hashing.
+   // part B on the bitboard engine, which shares the pool of the map
    //
-   std::size_t t0 = 0, h0 = 0, loop_size = 0;
-   std::set<size_t> hashes;
-   const size_t CYCLES = 1'000'000'000;
+   Bitboard board(map);
+#if 0
+   //
+   // brute force, without relying on loop detection
+   //
+   Bitboard brute(map);
    for (size_t cycle = 0; cycle < CYCLES; ++cycle)
-   {
-      //
-      // perform a cycle of sliding N, W, S, E
-      //
-      for (auto dir : {Direction::north, Direction::west, Direction::south, Direction::east})
-         map.slide(dir);
+      brute.cycle();
+   fmt::println("B: {} (brute force)", brute.weight());
+#endif
+   auto loop = findLoop(board);
+   fmt::println("loop from cycle {} to {}, size {}", loop.t0, loop.t0 + loop.size, loop.size);
 
-      //
-      // detect loops by keeping a set of hashes
-      //
-      auto hash = map.hash();
-      if (!hashes.insert(hash).second && !t0) // have we seen this hash already?
-      {
-         t0 = cycle, h0 = hash;
-         fmt::println("start of loop: {}", t0);
-      }
-      else if (h0 == hash && !loop_size) // ... and another time?
-      {
-         loop_size = cycle - t0;
-         fmt::println("end of loop at {}, size {}", cycle, cycle - t0);
-         size_t forward_loops = (CYCLES - cycle) / loop_size;
-         cycle += forward_loops * loop_size;
-         fmt::println("forwarded {} loops to {}", forward_loops, cycle);
-      }
-      else if (h0 == hash)
-         assert((cycle - t0) % loop_size == 0); // sanity check, but usually not reached
-   }
+#ifndef NDEBUG
+   //
+   // cross-check: the scalar engine must find the same loop, with the same weights
+   //
+   auto check = findLoop(map);
+   assert(check.t0 == loop.t0 && check.size == loop.size && check.weights == loop.weights);
+   assert(map.rocks() == board.rocks());
+
+   // the incremental state must match the one computed from scratch
+   auto hash = map.hash();
+   auto rocks = map.rocks();
+   auto weight = map.weight();
+   map.rehash();
+   assert(map.hash() == hash && map.rocks() == rocks && map.weight() == weight);
+   assert(weight == map.weight(Direction::north));
+#endif
+
+   //
+   // The board is at cycle t0 + size, which is the state of cycle t0. Catch up to the state after
+   // CYCLES for the dump and the image.
+   //
+   assert(CYCLES >= loop.t0);
+   for (size_t cycle = 0; cycle < (CYCLES - loop.t0) % loop.size; ++cycle)
+      board.cycle();
 
+   size_t B = loop.weightAfter(CYCLES);
+   assert(board.weight() == B);
+   board.store(map);
    map.dump();
-   size_t B = map.weight(Direction::north);
    fmt::println("A: {} B: {}", A, B);
+
+   if (argc > 2)
+      map.image().write(argv[2]);
 }
@@ -4,7 +4,11 @@
 #include <algorithm>
 #include <charconv>
 #include <cstdlib>
-#include <deque>
+#include <cstring>
+#include <unordered_map>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 #include <range/v3/algorithm/all_of.hpp>
 #include <range/v3/algorithm/fold_left.hpp>
 #include <range/v3/numeric/accumulate.hpp>
@@ -26,75 +30,359 @@ T to(const std::string_view& input)
    return out;
 }
 
-int main(int argc, char* argv[])
+// -------------------------------------------------------------------------------------------------
+
+//
+// Sum of HASH over comma separated steps. Input can be fed in pieces, with the HASH of a step that
+// is cut off being carried over to the next piece.
+//
+struct HashSum
 {
-   auto file = input(argc, argv);
+   size_t sum = 0;
+   uint8_t current = 0; // HASH of the step so far
+
+   void add(std::string_view text)
+   {
+      for (char c : text)
+         if (c == ',')
+            sum += current, current = 0;
+         else
+            current = (current + c) * 17;
+   }
+
+   // adds the last step, which has no comma after it
+   size_t finish()
+   {
+      sum += current;
+      current = 0;
+      return sum;
+   }
+};
 
-   std::string line;
-   std::getline(file, line);
-   assert(!line.empty());
+#if defined(__AVX2__)
+//
+// HASH sum of many steps at once: The text is cut at commas into 16 segments, one per 32-bit lane
+// of two AVX2 registers. Each lane walks its own segment, four bytes per gather, folding them into
+// its HASH. On a comma, the lane adds its HASH to its sum and starts over, so finding the
+// separators is part of the same pass. Lanes are masked once less than a word of their segment
+// is left, and these last few bytes are done by HashSum.
+//
+// Offsets are 32 bit, and a lane's sum must not overflow, so this works on blocks of up to 16 MB.
+//
+size_t hashSumBlock(std::string_view block)
+{
+   constexpr size_t REGS = 2, LANES = REGS * 8;
+   assert(block.size() <= (size_t{1} << 24));
 
-   auto steps = line | split(',') | transform([](auto&& rng) { //
-                   return std::string_view(&*rng.begin(), ranges::distance(rng));
-                });
+   std::array<int32_t, LANES + 1> cut;
+   cut[0] = 0, cut[LANES] = block.size();
+   for (size_t i = 1; i < LANES; ++i)
+   {
+      auto pos = block.find(',', std::max<size_t>(cut[i - 1], block.size() * i / LANES));
+      cut[i] = pos == std::string_view::npos ? block.size() : pos + 1;
+   }
 
+   std::array<int32_t, LANES> end;
+   for (size_t i = 0; i < LANES; ++i)
+      end[i] = cut[i] + (cut[i + 1] - cut[i]) / 4 * 4;
+
+   struct Lanes
+   {
+      __m256i pos, end, hash, sum;
+   };
+   std::array<Lanes, REGS> lanes;
+   for (size_t r = 0; r < REGS; ++r)
+      lanes[r] = {_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&cut[r * 8])),
+                  _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&end[r * 8])),
+                  _mm256_setzero_si256(), _mm256_setzero_si256()};
+
+   const auto base = reinterpret_cast<const int*>(block.data());
+   const auto comma = _mm256_set1_epi32(','), byte = _mm256_set1_epi32(0xff);
+   const auto four = _mm256_set1_epi32(4);
+   for (bool any = true; any;)
+   {
+      any = false;
+      for (auto& [pos, end, hash, sum] : lanes)
+      {
+         const auto active = _mm256_cmpgt_epi32(end, pos);
+         if (_mm256_testz_si256(active, active))
+            continue;
+         any = true;
+
+         auto word = _mm256_mask_i32gather_epi32(_mm256_setzero_si256(), base, pos, active, 1);
+         for (int j = 0; j < 4; ++j, word = _mm256_srli_epi32(word, 8))
+         {
+            const auto c = _mm256_and_si256(word, byte);
+            const auto separator = _mm256_and_si256(_mm256_cmpeq_epi32(c, comma), active);
+            sum = _mm256_add_epi32(sum, _mm256_and_si256(hash, separator));
+
+            // (hash + c) * 17 for active lanes, 0 after a comma
+            auto next = _mm256_add_epi32(hash, c);
+            next = _mm256_and_si256(_mm256_add_epi32(_mm256_slli_epi32(next, 4), next), byte);
+            hash = _mm256_blendv_epi8(hash, _mm256_andnot_si256(separator, next), active);
+         }
+         pos = _mm256_add_epi32(pos, _mm256_and_si256(active, four));
+      }
+   }
+
+   size_t total = 0;
+   for (size_t r = 0; r < REGS; ++r)
+   {
+      std::array<uint32_t, 8> pos, hash, sum;
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(pos.data()), lanes[r].pos);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(hash.data()), lanes[r].hash);
+      _mm256_storeu_si256(reinterpret_cast<__m256i*>(sum.data()), lanes[r].sum);
+      for (size_t i = 0; i < 8; ++i)
+      {
+         HashSum tail{sum[i], uint8_t(hash[i])};
+         tail.add(block.substr(pos[i], cut[r * 8 + i + 1] - pos[i]));
+         total += tail.finish();
+      }
+   }
+   return total;
+}
+#endif
+
+size_t hashSum(std::string_view text)
+{
+#if defined(__AVX2__)
    //
-   // part A
+   // Blocks end after a comma, so no step spans two blocks.
    //
-   auto rangeA = steps | transform([](auto&& sv) { //
-                    return fold_left(sv, 0, [](auto a, auto c) -> uint8_t { //
-                       return (a + c) * 17;
-                    });
-                 });
+   constexpr size_t BLOCK = size_t{1} << 24;
+   size_t total = 0;
+   while (text.size() > BLOCK)
+   {
+      auto pos = text.rfind(',', BLOCK - 1);
+      auto size = pos == std::string_view::npos ? BLOCK : pos + 1;
+      if (pos == std::string_view::npos) // a single step of 16 MB, not worth any SIMD
+      {
+         size = text.find(',');
+         size = size == std::string_view::npos ? text.size() : size + 1;
+         HashSum step;
+         step.add(text.substr(0, size));
+         total += step.finish();
+      }
+      else
+         total += hashSumBlock(text.substr(0, size));
+      text.remove_prefix(size);
+   }
+   return total + hashSumBlock(text);
+#else
+   HashSum sum;
+   sum.add(text);
+   return sum.finish();
+#endif
+}
+
+// -------------------------------------------------------------------------------------------------
+
+struct Label
+{
+   std::string_view label; // jg, mn
+   uint8_t hash; // 0..255
+   std::optional<int> focal_length; // 7, nullopt
+};
+
+//
+// The lenses of a box in order of insertion. Lenses are kept in slots that form a doubly linked
+// list, and an index maps each label to its slot, so both replacing and removing a lens are O(1).
+// Removed slots are unlinked and left behind as tombstones. Once these are the majority, the live
+// slots are compacted in list order and the index is rebuilt.
+//
+// The index owns the labels: its nodes never move, so slots can point to them.
+//
+class Box
+{
+public:
+   bool empty() const { return index.empty(); }
+
+   void upsert(std::string_view label, int focal_length)
+   {
+      if (auto it = index.find(label); it != index.end())
+      {
+         slots[it->second].focal_length = focal_length; // replace, keeping the position
+         return;
+      }
+
+      const auto slot = uint32_t(slots.size());
+      auto& entry = *index.emplace(label, slot).first;
+      slots.emplace_back(&entry, focal_length, tail, NONE);
+      (tail == NONE ? head : slots[tail].next) = slot;
+      tail = slot;
+   }
+
+   void remove(std::string_view label)
+   {
+      auto it = index.find(label);
+      if (it == index.end())
+         return;
+
+      auto& slot = slots[it->second];
+      (slot.prev == NONE ? head : slots[slot.prev].next) = slot.next;
+      (slot.next == NONE ? tail : slots[slot.next].prev) = slot.prev;
+      slot.entry = nullptr;
+      slot.prev = slot.next = TOMBSTONE;
+      index.erase(it);
+
+      if (slots.size() - index.size() > std::max(index.size(), MIN_COMPACT))
+         compact();
+   }
+
+   // calls f(label, focal_length) for all lenses, in order
+   template <typename F>
+   void forEach(F&& f) const
+   {
+      for (auto slot = head; slot != NONE; slot = slots[slot].next)
+         f(std::string_view(slots[slot].entry->first), slots[slot].focal_length);
+   }
 
-   size_t A = accumulate(rangeA, size_t{0});
-   fmt::println("A: {}", A);
+private:
+   static constexpr uint32_t NONE = ~uint32_t{0}, TOMBSTONE = NONE - 1;
+   static constexpr size_t MIN_COMPACT = 16; // tombstones to tolerate in small boxes
+
+   // heterogeneous lookup, so finding a label doesn't construct a string
+   struct Hash
+   {
+      using is_transparent = void;
+      size_t operator()(std::string_view label) const
+      {
+         return std::hash<std::string_view>{}(label);
+      }
+   };
+   using Index = std::unordered_map<std::string, uint32_t, Hash, std::equal_to<>>;
+
+   struct Slot
+   {
+      Index::value_type* entry; // label -> this slot
+      int focal_length;
+      uint32_t prev, next;
+   };
+
+   void compact()
+   {
+      std::vector<Slot> live;
+      live.reserve(index.size());
+      for (auto slot = head; slot != NONE; slot = slots[slot].next)
+      {
+         const auto i = uint32_t(live.size());
+         live.emplace_back(slots[slot].entry, slots[slot].focal_length, i ? i - 1 : NONE, NONE);
+         if (i)
+            live[i - 1].next = i;
+         live[i].entry->second = i;
+      }
+      slots = std::move(live);
+      head = slots.empty() ? NONE : 0;
+      tail = slots.empty() ? NONE : uint32_t(slots.size() - 1);
+   }
+
+   std::vector<Slot> slots;
+   Index index; // label -> slot
+   uint32_t head = NONE, tail = NONE;
+};
+
+//
+// Reads the initialization sequence in chunks, so memory stays bounded however long the line is.
+// Each call to next() returns a run of complete steps without the comma after the last one. A step
+// cut off at the end of a chunk is moved to the front of the buffer and completed by the next
+// read. The buffer only grows for a single step that is longer than a chunk.
+//
+class StepReader
+{
+public:
+   explicit StepReader(std::ifstream& file, size_t chunk = size_t{1} << 20)
+      : file(file), buffer(chunk)
+   {
+   }
+
+   std::optional<std::string_view> next()
+   {
+      std::memmove(buffer.data(), buffer.data() + used, size - used);
+      size -= used, used = 0;
+
+      while (!done)
+      {
+         if (size == buffer.size())
+            buffer.resize(buffer.size() * 2);
+
+         file.read(buffer.data() + size, buffer.size() - size);
+         auto begin = buffer.begin() + size, end = begin + file.gcount();
+         auto eol = std::find(begin, end, '\n'); // the sequence is a single line
+         size = eol - buffer.begin();
+         done = eol != end || !file;
+
+         auto comma = std::string_view(buffer.data(), size).rfind(',');
+         if (!done && comma != std::string_view::npos)
+         {
+            used = comma + 1;
+            return std::string_view(buffer.data(), comma);
+         }
+      }
+
+      if (size == 0)
+         return std::nullopt;
+      used = size; // last step, which has no comma
+      return std::string_view(buffer.data(), size);
+   }
+
+private:
+   std::ifstream& file;
+   std::vector<char> buffer;
+   size_t size = 0; // bytes in the buffer
+   size_t used = 0; // bytes returned by the last call to next()
+   bool done = false;
+};
+
+int main(int argc, char* argv[])
+{
+   auto file = input(argc, argv);
 
    //
-   // part B
+   // Each chunk of steps feeds both parts: the HASH sum for part A and the boxes for part B.
    //
-   struct Label
+   size_t A = 0;
+   std::array<Box, 256> boxes;
+   StepReader reader(file);
+   while (auto chunk = reader.next())
    {
-      std::string_view step; // jg=7, mn-
-      std::string_view label; // jg, mn
-      uint8_t hash; // 0..255
-      std::optional<int> focal_length; // 7, nullopt
-   };
+      A += hashSum(*chunk);
+
+      auto steps = *chunk | split(',') | transform([](auto&& rng) -> Label { //
+                      auto sv = std::string_view(&*rng.begin(), ranges::distance(rng));
+                      Label label;
+                      label.label = sv.substr(0, sv.find_last_of("=-"));
+                      label.hash = fold_left(label.label, 0, [](auto a, auto c) -> uint8_t { //
+                         return (a + c) * 17;
+                      });
+                      if (auto pos = sv.find_last_of('='); pos != std::string_view::npos)
+                         label.focal_length = to<int>(sv.substr(pos + 1));
+                      return label;
+                   });
 
-   auto rangeB = steps | transform([](auto&& sv) -> Label { //
-                    Label label{sv};
-                    label.step = sv;
-                    label.label = sv.substr(0, sv.find_last_of("=-"));
-                    label.hash = fold_left(label.label, 0, [](auto a, auto c) -> uint8_t { //
-                       return (a + c) * 17;
-                    });
-                    if (auto pos = sv.find_last_of('='); pos != std::string_view::npos)
-                       label.focal_length = to<int>(sv.substr(pos + 1));
-                    return label;
-                 });
-
-   std::array<std::deque<Label>, 256> boxes;
-   for (auto&& step : rangeB)
-   {
-      auto& deque = boxes[step.hash];
-
-      auto it = std::ranges::find(deque, step.label, &Label::label);
-      if (step.focal_length && it != deque.end())
-         *it = step; // overwrite existing lens
-      else if (step.focal_length)
-         deque.emplace_back(step); // add new lens
-      else if (it != deque.end())
-         deque.erase(it); // remove lens
+      for (auto&& step : steps)
+      {
+         if (step.focal_length)
+            boxes[step.hash].upsert(step.label, *step.focal_length); // add or replace lens
+         else
+            boxes[step.hash].remove(step.label);
+      }
    }
 
    for (auto&& [box, i] : zip(boxes, iota(0)))
       if (!box.empty())
-         fmt::println("box {}: {}", i, fmt::join(box | transform(&Label::step), ", "));
+      {
+         std::vector<std::string> lenses;
+         box.forEach([&](auto label, int focal_length)
+                     { lenses.emplace_back(fmt::format("{}={}", label, focal_length)); });
+         fmt::println("box {}: {}", i, fmt::join(lenses, ", "));
+      }
 
    size_t B = 0;
    for (auto&& [box, i] : zip(boxes, iota(1)))
-      for (auto&& [lens, j] : zip(box, iota(1)))
-         B += i * *lens.focal_length * j;
+   {
+      size_t j = 1;
+      box.forEach([&](auto, int focal_length) { B += i * focal_length * j++; });
+   }
 
    fmt::println("A: {} B: {}", A, B);
 }
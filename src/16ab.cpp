@@ -1,12 +1,12 @@
 //
 // https://adventofcode.com/2023/day/16
 //
-#include <range/v3/range/conversion.hpp>
-#include <range/v3/view/transform.hpp>
-using namespace ranges;
-using namespace ranges::views;
+#include <atomic>
+#include <span>
+#include <thread>
 
 #include "common.hpp"
+#include "frame.hpp"
 
 struct Coord
 {
@@ -31,134 +31,205 @@ struct Map
 {
    explicit Map(std::ifstream file)
    {
-      for (std::string line; std::getline(file, line);)
-         map.emplace_back(line | transform([](char c) { return Tile{c}; }) | to<std::vector>);
-
-      for (auto&& row : map)
-         assert(row.size() == width());
+      for (std::string line; std::getline(file, line); ++h)
+      {
+         assert(h == 0 || line.size() == w);
+         w = line.size();
+         for (char c : line)
+            tiles.push_back(Tile{c});
+      }
    }
 
-   std::vector<std::vector<Tile>> map;
-   int width() const { return map[0].size(); }
-   int height() const { return map.size(); }
+   size_t w = 0, h = 0;
+   std::vector<Tile> tiles; // row-major
 
-   Tile& at(const Coord& c)
-   {
-      if (c.y >= 0 && c.y < map.size())
-         if (c.x >= 0 && c.x <= map[c.y].size())
-            return map[c.y][c.x];
-
-      static Tile WALL = {'#'};
-      return WALL; // yes I know I'm returning a non-const reference to a static here
-   }
+   GridView<Tile> grid() { return GridView<Tile>::flat(tiles.data(), w, h); }
+   GridView<const Tile> grid() const { return GridView<const Tile>::flat(tiles.data(), w, h); }
+   int width() const { return w; }
+   int height() const { return h; }
 
    void dump() const
    {
-      for (auto& row : map)
+      auto& frame = screen();
+      for (auto row : grid())
       {
          for (auto& cell : row)
             if (cell.visited)
-               fmt::print("\x1b[44m{}\x1b[0m", cell.symbol);
+               frame.print("\x1b[44m{}\x1b[0m", cell.symbol);
             else
-               fmt::print("{}", cell.symbol);
-         fmt::println("");
+               frame.append(cell.symbol);
+         frame.newline();
       }
+      frame.flush();
    }
 
-   void trace(Coord pos, Coord dir)
+   Image image() const
    {
-      for (;;)
-      {
-         pos += dir;
-
-         auto& tile = at(pos);
-         if (tile.symbol == '#')
-            return;
-
-         switch (tile.symbol)
+      Image image(width(), height());
+      for (int y = 0; y < height(); ++y)
+         for (int x = 0; x < width(); ++x)
          {
-         case '#':
-            return; // wall, stop tracing
+            auto& tile = grid().at(x, y);
+            if (tile.visited)
+               image.set(x, y, {0, 0, 255});
+            else if (tile.symbol != '.')
+               image.set(x, y, {96, 96, 96});
+         }
+      return image;
+   }
 
-         case '/':
-            dir = -dir.transpose(); // reflection
-            break;
+   // flags all given cells as visited, for dump() and image()
+   void mark(std::span<const uint32_t> cells)
+   {
+      for (auto cell : cells)
+         tiles[cell].visited = true;
+   }
+};
 
-         case '\\':
-            dir = dir.transpose(); // reflection
-            break;
+//
+// Iterative beam engine: Beams still to follow are kept on an explicit stack, so there is no
+// recursion at splitters. Each cell has one bit per direction a beam has entered it in. A beam
+// that repeats one of these is dropped, which ends loops through mirrors and splitters alike.
+// Cells are listed when first touched, so counting and resetting cost O(energized), not O(grid).
+//
+class Beams
+{
+public:
+   explicit Beams(GridView<const Tile> grid) : grid(grid), seen(grid.width() * grid.height()) {}
 
-         case '-':
-            if (dir.x)
-               break; // horizontal pass through
+   // follows a beam entering the grid from 'pos', returns the number of energized cells
+   size_t trace(Coord pos, Coord dir)
+   {
+      reset();
+      stack.push_back({pos, dir});
+      while (!stack.empty())
+      {
+         auto [pos, dir] = stack.back();
+         stack.pop_back();
+         for (;;)
+         {
+            pos += dir;
+            if (!grid.contains(pos.x, pos.y))
+               break;
+
+            const auto cell = uint32_t(pos.y * grid.width() + pos.x);
+            const auto bit = uint8_t(1 << direction(dir));
+            if (seen[cell] & bit)
+               break;
+            if (!seen[cell])
+               cells.emplace_back(cell);
+            seen[cell] |= bit;
+
+            switch (grid.at(pos.x, pos.y).symbol)
+            {
+            case '/':
+               dir = -dir.transpose();
+               break;
+            case '\\':
+               dir = dir.transpose();
+               break;
+            case '-':
+               if (dir.y)
+               {
+                  stack.push_back({pos, Coord{1, 0}});
+                  dir = Coord{-1, 0};
+               }
+               break;
+            case '|':
+               if (dir.x)
+               {
+                  stack.push_back({pos, Coord{0, 1}});
+                  dir = Coord{0, -1};
+               }
+               break;
+            }
+         }
+      }
+      return cells.size();
+   }
 
-            if (tile.visited)
-               return; // endless loop otherwise
+   // cells energized by the last trace, row-major indices
+   std::span<const uint32_t> energized() const { return cells; }
 
-            tile.visited = true;
-            trace(pos, Coord{-1, 0});
-            trace(pos, Coord{1, 0});
-            return;
+private:
+   static int direction(Coord dir) { return dir.x ? (dir.x > 0 ? 0 : 1) : (dir.y > 0 ? 2 : 3); }
 
-         case '|':
-            if (dir.y)
-               break; // vertical pass through
+   void reset()
+   {
+      for (auto cell : cells)
+         seen[cell] = 0;
+      cells.clear();
+   }
 
-            if (tile.visited)
-               return; // endless loop otherwise
+   struct Beam
+   {
+      Coord pos, dir;
+   };
 
-            tile.visited = true;
-            trace(pos, Coord{0, -1});
-            trace(pos, Coord{0, 1});
-            return;
-         }
+   GridView<const Tile> grid;
+   std::vector<uint8_t> seen; // one bit per direction entered in
+   std::vector<uint32_t> cells;
+   std::vector<Beam> stack;
+};
 
-         tile.visited = true;
-      }
+//
+// Part B: launches from all edge cells are independent. Each worker has its own Beams, i.e. its
+// own visited bits, over the shared read-only grid, and takes launches from a common queue, which
+// is just an atomic index. The maximum is kept per worker and reduced after joining.
+//
+size_t maxEnergized(GridView<const Tile> grid, size_t threads)
+{
+   struct Launch
+   {
+      Coord pos, dir;
+   };
+   std::vector<Launch> launches;
+   const int w = grid.width(), h = grid.height();
+   for (int x = 0; x < w; ++x)
+   {
+      launches.push_back({{x, -1}, {0, 1}});
+      launches.push_back({{x, h}, {0, -1}});
    }
+   for (int y = 0; y < h; ++y)
+   {
+      launches.push_back({{-1, y}, {1, 0}});
+      launches.push_back({{w, y}, {-1, 0}});
+   }
+
+   std::atomic<size_t> next = 0;
+   std::vector<size_t> results(threads);
+   std::vector<std::thread> workers;
+   for (size_t t = 0; t < threads; ++t)
+      workers.emplace_back(
+         [&, t]
+         {
+            Beams beams(grid);
+            for (size_t i; (i = next.fetch_add(1, std::memory_order_relaxed)) < launches.size();)
+               results[t] = std::max(results[t], beams.trace(launches[i].pos, launches[i].dir));
+         });
 
-   // count visited tiles and reset visited state 
-   int takeVisted()
+   size_t result = 0;
+   for (size_t t = 0; t < threads; ++t)
    {
-      int result = 0;
-      for (auto& row : map)
-         for (auto& cell : row)
-            if (cell.visited)
-            {
-               cell.visited = false;
-               result++;
-            }
-      return result;
+      workers[t].join();
+      result = std::max(result, results[t]);
    }
-};
+   return result;
+}
 
 int main(int argc, char* argv[])
 {
    Map map(input(argc, argv));
 
-   Coord pos{-1, 0}, dir{1, 0};
-   map.trace(pos, dir);
+   Beams beams(map.grid());
+   size_t A = beams.trace({-1, 0}, {1, 0});
+   map.mark(beams.energized());
    map.dump();
-   size_t A = map.takeVisted();
+   if (argc > 2)
+      map.image().write(argv[2]);
 
-   int B = 0;
-   for (int x = 0; x < map.width(); ++x)
-   {
-      map.trace({x, -1}, {0, 1});
-      B = std::max(B, map.takeVisted());
-
-      map.trace({x, map.height()}, {0, -1});
-      B = std::max(B, map.takeVisted());
-   }
-
-   for (int y = 0; y < map.width(); ++y)
-   {
-      map.trace({-1, y}, {1, 0});
-      B = std::max(B, map.takeVisted());
-
-      map.trace({map.width(), y}, {-1, 0});
-      B = std::max(B, map.takeVisted());
-   }
+   const size_t threads = std::max(1u, std::thread::hardware_concurrency());
+   size_t B = maxEnergized(map.grid(), threads);
 
    fmt::println("A: {}", A);
    fmt::println("B: {}", B);
@@ -1,12 +1,11 @@
 //
 // https://adventofcode.com/2023/day/17
 //
-#include <range/v3/range/conversion.hpp>
-#include <range/v3/view/transform.hpp>
-using namespace ranges;
-using namespace ranges::views;
+#include <array>
+#include <limits>
 
 #include "common.hpp"
+#include "frame.hpp"
 
 struct Coord
 {
@@ -35,23 +34,28 @@ struct Map
 {
    explicit Map(std::ifstream file)
    {
-      for (std::string line; std::getline(file, line);)
-         map.emplace_back(line | transform([](char c) { return Tile{c}; }) | to<std::vector>);
-
-      for (auto&& row : map)
-         assert(row.size() == width());
+      for (std::string line; std::getline(file, line); ++h)
+      {
+         assert(h == 0 || line.size() == w);
+         w = line.size();
+         for (char c : line)
+            tiles.push_back(Tile{c});
+      }
    }
 
-   std::vector<std::vector<Tile>> map;
+   size_t w = 0, h = 0;
+   std::vector<Tile> tiles; // row-major
+
+   GridView<Tile> grid() { return GridView<Tile>::flat(tiles.data(), w, h); }
+   GridView<const Tile> grid() const { return GridView<const Tile>::flat(tiles.data(), w, h); }
 
-   int width() const { return map[0].size(); }
-   int height() const { return map.size(); }
+   int width() const { return w; }
+   int height() const { return h; }
 
    Tile& at(const Coord& c)
    {
-      if (c.y >= 0 && c.y < map.size())
-         if (c.x >= 0 && c.x <= map[c.y].size())
-            return map[c.y][c.x];
+      if (grid().contains(c.x, c.y))
+         return grid().at(c.x, c.y);
 
       static Tile WALL = {'#'};
       return WALL; // yes I know I'm returning a non-const reference to a static here
@@ -59,12 +63,23 @@ struct Map
 
    void dump() const
    {
-      for (auto& row : map)
+      auto& frame = screen();
+      for (auto row : grid())
       {
          for (auto& cell : row)
-            fmt::print("\x1b[48;5;{}m{}\x1b[0m", HEAT[cell.symbol - '0'], cell.symbol);
-         fmt::println("");
+            frame.print("\x1b[48;5;{}m{}\x1b[0m", HEAT[cell.symbol - '0'], cell.symbol);
+         frame.newline();
       }
+      frame.flush();
+   }
+
+   Image image() const
+   {
+      Image image(width(), height());
+      for (int y = 0; y < height(); ++y)
+         for (int x = 0; x < width(); ++x)
+            image.set(x, y, xterm256(HEAT[grid().at(x, y).symbol - '0']));
+      return image;
    }
 
    void trace(Coord pos, Coord dir, int run)
@@ -82,4 +97,7 @@ int main(int argc, char* argv[])
 
    Map map(input(argc, argv));
    map.dump();
+
+   if (argc > 2)
+      map.image().write(argv[2]);
 }
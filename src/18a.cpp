@@ -12,6 +12,7 @@ using namespace ranges::views;
 #include <boost/regex.hpp>
 
 #include "common.hpp"
+#include "frame.hpp"
 
 struct Coord
 {
@@ -46,8 +47,13 @@ struct Tile
 static std::array<int, 10> HEAT{16, 18, 20, 56, 91, 160, 166, 178, 184, 229};
 static const std::array<Coord, 4> AROUND = {{{-1, 0}, {0, -1}, {1, 0}, {0, 1}}};
 
-const std::map<char, std::string_view> LINE_DRAWING = {
-   {'.', "."}, {'-', "─"}, {'|', "│"}, {'L', "└"}, {'J', "┘"}, {'7', "┐"}, {'F', "┌"}};
+constexpr std::array<std::string_view, 128> LINE_DRAWING = []
+{
+   std::array<std::string_view, 128> symbols{};
+   symbols['.'] = ".", symbols['-'] = "─", symbols['|'] = "│", symbols['L'] = "└";
+   symbols['J'] = "┘", symbols['7'] = "┐", symbols['F'] = "┌";
+   return symbols;
+}();
 
 const std::map<char, Coord> DIRECTIONS = {
    {'L', Coord{-1, 0}},
@@ -89,16 +95,27 @@ struct Map
 
    void dump() const
    {
+      auto& frame = screen();
       for (auto& row : map)
       {
          for (auto& cell : row)
          {
             auto c = cell.color;
-            auto symbol = LINE_DRAWING.at(cell.symbol);
-            fmt::print("\x1b[48;2;{};{};{}m{}\x1b[0m", c >> 16, (c >> 8) & 255, c & 255, symbol);
+            auto symbol = LINE_DRAWING[cell.symbol];
+            frame.print("\x1b[48;2;{};{};{}m{}\x1b[0m", c >> 16, (c >> 8) & 255, c & 255, symbol);
          }
-         fmt::println("");
+         frame.newline();
       }
+      frame.flush();
+   }
+
+   Image image() const
+   {
+      Image image(width(), height());
+      for (int y = 0; y < height(); ++y)
+         for (int x = 0; x < width(); ++x)
+            image.set(x, y, Color::rgb(map[y][x].color));
+      return image;
    }
 
    void trace(Coord pos, Coord dir, int run)
@@ -213,4 +230,7 @@ int main(int argc, char* argv[])
 
    map.dump();
    fmt::println("A: {}", A);
+
+   if (argc > 2)
+      map.image().write(argv[2]);
 }
@@ -1,141 +1,453 @@
+//
+// https://adventofcode.com/2023/day/8
+//
+#include <numeric>
+#include <set>
 #include <string>
 using namespace std::literals;
 
 #include <range/v3/algorithm/all_of.hpp>
-#include <range/v3/range/conversion.hpp>
-#include <range/v3/view/filter.hpp>
-#include <range/v3/view/iota.hpp>
-#include <range/v3/view/map.hpp>
 #include <range/v3/view/transform.hpp>
-#include <range/v3/view/zip.hpp>
 using namespace ranges;
 using namespace ranges::views;
 
-#define BOOST_REGEX_MATCH_EXTRA
-#include <boost/regex.hpp>
+#include <boost/dynamic_bitset.hpp>
 
-#include <boost/integer/common_factor_rt.hpp>
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
 
 #include "common.hpp"
 
-struct Node;
-using NodePtr = std::unique_ptr<Node>;
-struct Node
+//
+// Node ids are three characters out of [0-9A-Z]. Packed as a base-36 number, they fit into a
+// uint16_t (36^3 = 46656). That number is only used while parsing, to give every node a dense
+// index in order of first appearance. This keeps left[] and right[] as small as the node count.
+//
+constexpr size_t ID_BASE = 36;
+constexpr size_t ID_SPACE = ID_BASE * ID_BASE * ID_BASE;
+constexpr uint16_t NONE = std::numeric_limits<uint16_t>::max();
+
+constexpr size_t encode(std::string_view id)
 {
-   std::string id;
-   Node* left = nullptr;
-   Node* right = nullptr;
-   std::set<size_t> visited;
+   size_t result = 0;
+   for (char c : id)
+      result = result * ID_BASE + (c <= '9' ? c - '0' : c - 'A' + 10);
+   return result;
+}
+
+struct Graph
+{
+   explicit Graph(std::ifstream file) : lookup(ID_SPACE, NONE)
+   {
+      std::getline(file, instructions);
+      for (std::string line; std::getline(file, line);)
+      {
+         if (line.empty())
+            continue;
+
+         // AAA = (BBB, CCC)
+         std::string_view sv = line;
+         auto node = intern(sv.substr(0, 3));
+         left[node] = intern(sv.substr(7, 3));
+         right[node] = intern(sv.substr(12, 3));
+      }
+   }
+
+   std::string instructions;
+   std::vector<uint16_t> left, right;
+   boost::dynamic_bitset<uint32_t> start, end; // id ends with 'A' or 'Z', respectively
+   std::vector<std::string> ids; // for output only
+   std::vector<uint16_t> lookup; // encode(id) -> index
+
+   size_t size() const { return left.size(); }
+   uint16_t find(std::string_view id) const { return lookup[encode(id)]; }
+   uint16_t step(uint16_t node, size_t i) const
+   {
+      return instructions[i] == 'L' ? left[node] : right[node];
+   }
+
+private:
+   uint16_t intern(std::string_view id)
+   {
+      auto& index = lookup[encode(id)];
+      if (index == NONE)
+      {
+         index = size();
+         left.emplace_back(NONE);
+         right.emplace_back(NONE);
+         start.push_back(id[2] == 'A');
+         end.push_back(id[2] == 'Z');
+         ids.emplace_back(id);
+      }
+      return index;
+   }
 };
 
-struct NodeCmp
+// -------------------------------------------------------------------------------------------------
+
+//
+// A ghost's state is (node, instruction index). After 'tail' steps it enters a cycle of 'length'
+// steps. Z-hits within the tail happen only once, hits within the cycle repeat every 'length'.
+//
+struct Cycle
 {
-   using is_transparent = void;
-   bool operator()(const NodePtr& l, const NodePtr& r) const { return l->id < r->id; };
-   bool operator()(const NodePtr& l, const std::string& r) const { return l->id < r; };
-   bool operator()(const std::string& r, const NodePtr& l) const { return r < l->id; };
+   size_t tail = 0, length = 0;
+   std::vector<size_t> tail_hits, cycle_hits; // step numbers, sorted
+
+   bool hit(size_t step) const
+   {
+      if (step < tail)
+         return std::ranges::binary_search(tail_hits, step);
+      return std::ranges::binary_search(cycle_hits, tail + (step - tail) % length);
+   }
 };
 
-int main(int argc, char* argv[])
+constexpr uint32_t UNSEEN = std::numeric_limits<uint32_t>::max();
+
+//
+// Walk until a state repeats, recording the step number of every state in 'seen', which is a flat
+// array of size nodes * instructions. It is reset afterwards by walking the same path again.
+//
+Cycle analyze(const Graph& graph, uint16_t start, std::vector<uint32_t>& seen)
 {
-   auto file = input(argc, argv);
+   const size_t n = graph.instructions.size();
+   assert(seen.size() == graph.size() * n);
 
-   std::set<NodePtr, NodeCmp> nodes;
+   std::vector<size_t> hits;
+   size_t step = 0;
+   uint16_t node = start;
+   for (size_t i; i = step % n, seen[node * n + i] == UNSEEN; ++step)
+   {
+      seen[node * n + i] = step;
+      if (graph.end.test(node))
+         hits.emplace_back(step);
+      node = graph.step(node, i);
+   }
 
-   auto instructions = *getline(file);
-   fmt::println("instructions: {}", instructions);
-   getline(file);
+   Cycle cycle;
+   cycle.tail = seen[node * n + step % n];
+   cycle.length = step - cycle.tail;
+   auto split = std::ranges::lower_bound(hits, cycle.tail);
+   cycle.tail_hits.assign(hits.begin(), split);
+   cycle.cycle_hits.assign(split, hits.end());
+
+   node = start;
+   for (size_t i = 0; i < step; ++i)
+   {
+      seen[node * n + i % n] = UNSEEN;
+      node = graph.step(node, i % n);
+   }
+   return cycle;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+// t = residue (mod modulus)
+struct Congruence
+{
+   size_t residue, modulus;
+   auto operator<=>(const Congruence&) const = default;
+};
+
+//
+// Generalized CRT: moduli need not be coprime. Returns nullopt if there is no common solution.
+//
+std::optional<Congruence> combine(const Congruence& a, const Congruence& b)
+{
+   using int128 = __int128;
+
+   // a.residue + a.modulus * k = b.residue (mod b.modulus), solve for k
+   auto g = std::gcd(a.modulus, b.modulus);
+   auto diff = int128(b.residue) - int128(a.residue);
+   if (diff % g != 0)
+      return std::nullopt;
+
+   // inverse of a.modulus / g modulo m, by extended euclid
+   int128 m = b.modulus / g, r0 = (a.modulus / g) % m, r1 = m, s0 = 1, s1 = 0;
+   while (r1 != 0)
+   {
+      int128 q = r0 / r1;
+      std::tie(r0, r1) = std::make_pair(r1, r0 - q * r1);
+      std::tie(s0, s1) = std::make_pair(s1, s0 - q * s1);
+   }
+
+   auto k = ((diff / g) % m * s0 % m + m) % m;
+   int128 lcm = int128(a.modulus / g) * b.modulus;
+   if (lcm > std::numeric_limits<size_t>::max())
+      throw std::overflow_error("CRT modulus exceeds 64 bits");
+
+   return Congruence{size_t((a.residue + a.modulus * k) % lcm), size_t(lcm)};
+}
+
+//
+// Find the first step at which all ghosts are on a Z-node at the same time.
+//
+// Steps before the longest tail are checked directly. After that, all ghosts are within their
+// cycles and each contributes a set of congruences, one per Z-hit within the cycle.
+//
+std::optional<size_t> solve(const std::vector<Cycle>& cycles)
+{
+   auto hitByAll = [&](size_t step)
+   { return std::ranges::all_of(cycles, [&](auto& cycle) { return cycle.hit(step); }); };
+
+   size_t tail = std::ranges::max(cycles | transform(&Cycle::tail));
+   for (size_t step = 0; step < tail; ++step)
+      if (hitByAll(step))
+         return step;
 
-   static const boost::regex regexp{R"((\w+) = \((\w+), (\w+)\))"};
-   while (auto line = getline(file))
+   std::set<Congruence> solutions{{0, 1}};
+   for (auto& cycle : cycles)
    {
-      boost::smatch what;
-      boost::regex_match(*line, what, regexp, boost::match_extra | boost::match_perl);
-      nodes.insert(std::make_unique<Node>(what[1].str()));
+      std::set<Congruence> next;
+      for (auto& solution : solutions)
+         for (auto hit : cycle.cycle_hits)
+            if (auto c = combine(solution, {hit % cycle.length, cycle.length}))
+               next.insert(*c);
+      solutions = std::move(next);
    }
-   file.clear();
-   file.seekg(0);
-   getline(file);
-   getline(file);
-   while (auto line = getline(file))
+
+   std::optional<size_t> result;
+   for (auto& [residue, modulus] : solutions)
    {
-      boost::smatch what;
-      boost::regex_match(*line, what, regexp, boost::match_extra | boost::match_perl);
-      auto& node = *nodes.find(std::string(what[1].str()));
-      node->left = nodes.find(what[2].str())->get();
-      node->right = nodes.find(what[3].str())->get();
+      auto step = tail + (residue + modulus - tail % modulus) % modulus;
+      result = std::min(result.value_or(step), step);
    }
+   return result;
+}
+
+//
+// Binary lifting over full passes of the instruction string: After 2^k passes, a ghost starting at
+// 'node' ends up at jump[k][node], and z[k][node] tells if it was on a Z-node after any of the
+// steps on the way. This allows walks of 10^15 steps in logarithmic time.
+//
+struct JumpTable
+{
+   static constexpr size_t LEVELS = 48;
 
-   for (auto& node : nodes)
-      fmt::println("{} -> ({}, {})", node->id, node->left->id, node->right->id);
+   explicit JumpTable(const Graph& graph)
+      : graph(graph), n(graph.instructions.size()), jump(LEVELS * graph.size()),
+        z(LEVELS * graph.size())
+   {
+      const size_t N = graph.size();
+      for (size_t start = 0; start < N; ++start)
+      {
+         uint16_t node = start;
+         for (size_t i = 0; i < n; ++i)
+            if (node = graph.step(node, i); graph.end.test(node))
+               z.set(start);
+         jump[start] = node;
+      }
+
+      for (size_t k = 1; k < LEVELS; ++k)
+         for (size_t node = 0; node < N; ++node)
+         {
+            auto half = jump[(k - 1) * N + node];
+            jump[k * N + node] = jump[(k - 1) * N + half];
+            z[k * N + node] = z[(k - 1) * N + node] || z[(k - 1) * N + half];
+         }
+   }
+
+   // move forward by a number of full passes
+   uint16_t pass(uint16_t node, size_t passes) const
+   {
+      assert(passes >> LEVELS == 0);
+      for (size_t k = 0; passes; ++k, passes >>= 1)
+         if (passes & 1)
+            node = jump[k * graph.size() + node];
+      return node;
+   }
+
+   // move forward by any number of steps
+   uint16_t advance(uint16_t node, size_t steps) const
+   {
+      node = pass(node, steps / n);
+      for (size_t i = 0; i < steps % n; ++i)
+         node = graph.step(node, i);
+      return node;
+   }
+
+   // number of full passes that can be done without ever being on a Z-node
+   size_t miss(uint16_t node) const
+   {
+      size_t passes = 0;
+      for (size_t k = LEVELS; k-- > 0;)
+         if (!z.test(k * graph.size() + node))
+         {
+            node = jump[k * graph.size() + node];
+            passes += size_t{1} << k;
+         }
+      return passes;
+   }
+
+   const Graph& graph;
+   const size_t n;
+   std::vector<uint16_t> jump; // [k * N + node]
+   boost::dynamic_bitset<uint64_t> z; // [k * N + node]
+};
+
+//
+// Lock-step simulation of all ghosts, eight per AVX2 register. All ghosts follow the same
+// instruction, so each step is a single gather from either left[] or right[]. Being on a Z-node
+// is tested by gathering words of the 'end' bitmask, with one compare for all lanes.
+//
+// Returns the first step at which all ghosts are on a Z-node, if there is one up to 'limit'.
+//
+std::optional<size_t> simulate(const Graph& graph, std::span<const uint16_t> starts, size_t limit)
+{
+   const size_t n = graph.instructions.size();
+#if defined(__AVX2__)
+   const std::vector<int32_t> left(graph.left.begin(), graph.left.end());
+   const std::vector<int32_t> right(graph.right.begin(), graph.right.end());
+   std::vector<int32_t> end;
+   boost::to_block_range(graph.end, std::back_inserter(end));
+
+   // unused lanes are marked 'inactive' and always count as being on a Z-node
+   struct Lanes
+   {
+      __m256i ghost, inactive;
+   };
+   std::vector<Lanes> lanes;
+   for (size_t i = 0; i < starts.size(); i += 8)
+   {
+      std::array<int32_t, 8> pos{}, mask{};
+      for (size_t lane = 0; lane < 8; ++lane)
+         if (i + lane < starts.size())
+            pos[lane] = starts[i + lane];
+         else
+            mask[lane] = -1;
+      lanes.emplace_back(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(pos.data())),
+                         _mm256_loadu_si256(reinterpret_cast<const __m256i*>(mask.data())));
+   }
+
+   const auto one = _mm256_set1_epi32(1), bit = _mm256_set1_epi32(31);
+   for (size_t step = 0, i = 0; step <= limit; ++step)
+   {
+      auto all = _mm256_set1_epi32(-1);
+      for (auto& [ghost, inactive] : lanes)
+      {
+         auto words = _mm256_i32gather_epi32(end.data(), _mm256_srli_epi32(ghost, 5), 4);
+         auto z = _mm256_srlv_epi32(words, _mm256_and_si256(ghost, bit));
+         all = _mm256_and_si256(all, _mm256_or_si256(_mm256_and_si256(z, one), inactive));
+      }
+      if (_mm256_movemask_epi8(_mm256_cmpeq_epi32(all, _mm256_setzero_si256())) == 0)
+         return step;
+
+      const int32_t* next = graph.instructions[i] == 'L' ? left.data() : right.data();
+      for (auto& [ghost, inactive] : lanes)
+         ghost = _mm256_i32gather_epi32(next, ghost, 4);
+
+      if (++i == n)
+         i = 0;
+   }
+#else
+   std::vector<uint16_t> ghosts(starts.begin(), starts.end());
+   for (size_t step = 0; step <= limit; ++step)
+   {
+      if (all_of(ghosts, [&](auto node) { return graph.end.test(node); }))
+         return step;
+      for (auto& node : ghosts)
+         node = graph.step(node, step % n);
+   }
+#endif
+   return std::nullopt;
+}
+
+// -------------------------------------------------------------------------------------------------
+
+int main(int argc, char* argv[])
+{
+   Graph graph(input(argc, argv));
+   const auto& instructions = graph.instructions;
+   fmt::println("instructions: {}", instructions);
+
+   for (size_t node = 0; node < graph.size(); ++node)
+      fmt::println("{} -> ({}, {})", graph.ids[node], graph.ids[graph.left[node]],
+                   graph.ids[graph.right[node]]);
 
    //
    // part A
    //
-   auto distance = [&](Node* node, Node* destination) -> size_t
+   auto distance = [&](uint16_t node, uint16_t destination) -> size_t
    {
       size_t steps = 0;
       for (size_t i; i = steps % instructions.size(), node != destination; ++steps)
-         node = instructions[i] == 'L' ? node->left : node->right;
+         node = graph.step(node, i);
       return steps;
    };
 
-   size_t A = distance(nodes.find("AAA")->get(), nodes.find("ZZZ")->get());
+   size_t A = distance(graph.find("AAA"), graph.find("ZZZ"));
    fmt::println("steps A: {}", A);
 
    //
    // part B (brute force / LCM)
    //
+   const size_t n = instructions.size();
    size_t B = 0;
+   std::vector<uint16_t> starts;
+   for (auto start = graph.start.find_first(); start != graph.start.npos;
+        start = graph.start.find_next(start))
+      starts.emplace_back(start);
+
+   const JumpTable jumps(graph);
+   auto allOnZ = [&](auto& ghosts)
+   { return all_of(ghosts, [&](auto node) { return graph.end.test(node); }); };
+
 #if 0
-   auto iterators = nodes | filter([](auto& e) { return e->id[2] == 'A'; }) |
-                    transform([](auto& e) { return e.get(); }) | to<std::vector>;                   
-   while (!all_of(iterators, [](auto& e) { return e->id[2] == 'Z'; }))
+   //
+   // Brute force: Skip as many passes as there is at least one ghost that does not see a Z-node
+   // during them. Only if all ghosts do, step through that pass one by one.
+   //
+   for (auto ghosts = starts; !allOnZ(ghosts);)
    {
       fmt::println("{} {}", B,
-                   fmt::join(iterators | transform([](const auto& e) { return e->id; }), ", "));
-      auto d = instructions[B++ % instructions.size()];
-      for (auto& node : iterators)
-         node = d == 'L' ? node->left : node->right;
-   }
-#else
-   struct LoopInfo
-   {
-      Node* start;
-      size_t distance_to_loop, loop_size;
-   };
-   std::vector<LoopInfo> loops;
+                   fmt::join(ghosts | transform([&](auto node) { return graph.ids[node]; }), ", "));
 
-   for (auto start : nodes | filter([](auto& e) { return e->id[2] == 'A'; }) |
-                        transform([](auto& e) { return e.get(); }))
-   {
-      for (auto& node : nodes)
-         node->visited.clear();
-
-      size_t step = 0;
-      auto* node = start;
-      for (size_t i; i = step % instructions.size(), !node->visited.contains(i); ++step)
+      auto misses = ghosts | transform([&](auto node) { return jumps.miss(node); });
+      auto passes = std::ranges::max(misses);
+      if (passes)
       {
-         node->visited.emplace(i);
-         node = instructions[i] == 'L' ? node->left : node->right;
-      };
-
-      auto distance_to_loop = distance(start, node);
-      auto loop_size = step - distance_to_loop;
+         for (auto& node : ghosts)
+            node = jumps.pass(node, passes);
+         B += passes * n;
+         continue;
+      }
 
-      auto* dest = start;
-      for (size_t i = 0; i < loop_size; ++i)
-         dest = instructions[i] == 'L' ? dest->left : dest->right;
-
-      fmt::println("{} loop at {}, visited={}, distance_to_loop={}, loop_size={} --> {}", start->id,
-                   node->id, node->visited.size(), distance_to_loop, loop_size, dest->id);
-      loops.emplace_back(start, distance_to_loop, loop_size);
+      for (size_t i = 0; i < n && !allOnZ(ghosts); ++i, ++B)
+         for (auto& node : ghosts)
+            node = graph.step(node, i);
+   }
+#else
+   //
+   // Analyze cycles of all ghosts and combine them using the generalized CRT. This does not rely
+   // on the puzzle input being constructed such that the LCM of loop sizes is the answer.
+   //
+   std::vector<Cycle> cycles;
+   std::vector<uint32_t> seen(graph.size() * n, UNSEEN);
+   for (auto start : starts)
+   {
+      auto& cycle = cycles.emplace_back(analyze(graph, start, seen));
+      fmt::println("{}: tail={}, length={}, tail_hits=[{}], cycle_hits=[{}]", graph.ids[start],
+                   cycle.tail, cycle.length, fmt::join(cycle.tail_hits, ", "),
+                   fmt::join(cycle.cycle_hits, ", "));
    }
 
-   // I don't know why, but the solution is just the LCM of the loop sizes, despite initial path
-   auto loop_sizes = loops | transform([](auto& info) { return info.loop_size; });
-   B = boost::integer::lcm_range(loop_sizes.begin(), loop_sizes.end()).first;
+   if (auto solution = solve(cycles))
+      B = *solution;
+   else
+      fmt::println("ghosts never meet on Z nodes");
 #endif
 
-   fmt::println("steps B: {}", B);
+   //
+   // verify: after B steps, all ghosts must be on a Z-node
+   //
+   auto ghosts = starts | transform([&](auto node) { return jumps.advance(node, B); });
+   fmt::println("steps B: {} ({})", B, allOnZ(ghosts) ? "verified" : "NOT VERIFIED");
+
+   //
+   // validate by lock-step simulation, if that is feasible
+   //
+   constexpr size_t SIMULATION_LIMIT = 1'000'000'000;
+   if (B <= SIMULATION_LIMIT)
+      fmt::println("steps B: {} (simulated)", simulate(graph, starts, B));
 }
@@ -1,17 +1,14 @@
 //
 // https://adventofcode.com/2023/day/9
 //
+#include <map>
 #include <sstream>
 #include <string>
 using namespace std::literals;
 
-#include <range/v3/algorithm/all_of.hpp>
 #include <range/v3/range/conversion.hpp>
-#include <range/v3/view/drop.hpp>
 #include <range/v3/view/istream.hpp>
-#include <range/v3/view/transform.hpp>
-#include <range/v3/view/zip.hpp>
-#include "range/v3/view/istream.hpp"
+#include <range/v3/view/take.hpp>
 using namespace ranges;
 using namespace ranges::views;
 
@@ -29,36 +26,208 @@ struct Result
    }
 };
 
-Result delta(const std::vector<long>& numbers)
+//
+// Extrapolating the difference pyramid of n numbers by one step is a fixed linear combination of
+// those numbers, with binomial coefficients that depend only on n:
+//
+//   back  = sum (-1)^(n-1-i) * C(n, i)   * x[i]
+//   front = sum (-1)^i       * C(n, i+1) * x[i]
+//
+// The coefficients grow like 2^n / sqrt(n), so their products with the numbers, and the partial
+// sums, overflow long long before the extrapolation does. Dot products are therefore done in
+// uint64_t, which wraps around modulo 2^64: the result is exact whenever it fits into long.
+//
+struct Kernel
 {
-   fmt::println("[{}]", fmt::join(numbers, " "));
+   // C(n, i) and c * (n - i) while computing it still fit into long
+   static constexpr size_t MAX_LENGTH = 60;
 
-   if (all_of(numbers, [&](auto n) { return n == 0; }))
-      return {};
+   explicit Kernel(size_t n) : forward(n), backward(n)
+   {
+      assert(n <= MAX_LENGTH);
+      long c = 1; // C(n, i)
+      for (size_t i = 0; i < n; ++i)
+      {
+         forward[i] = (n - 1 - i) % 2 ? -c : c;
+         c = c * long(n - i) / long(i + 1);
+         backward[i] = i % 2 ? -c : c;
+      }
+   }
 
-   std::vector deltas = zip(numbers, numbers | drop(1)) |
-                        transform([](auto pair) { return pair.second - pair.first; }) |
-                        to<std::vector>;
+   size_t size() const { return forward.size(); }
 
-   auto decend = delta(deltas);
-   auto result = Result{numbers.front() - decend.front, decend.back + numbers.back()};
-   fmt::println("[{} {} {}]", result.front, fmt::join(numbers, " "), result.back);
-   return result;
-}
+   Result operator()(std::span<const long> numbers) const { return dot(numbers); }
+
+   //
+   // Sum of extrapolations over many sequences of the same length, stored back to back. As the
+   // kernel is linear, the sequences can be summed up first. That inner loop is a plain vector
+   // add, which the compiler turns into SIMD, and there is only one dot product at the end.
+   //
+   Result sum(std::span<const long> numbers) const
+   {
+      assert(numbers.size() % size() == 0);
+      std::vector<uint64_t> column(size());
+      for (auto p = numbers.data(), end = p + numbers.size(); p != end; p += size())
+         for (size_t i = 0; i < size(); ++i)
+            column[i] += uint64_t(p[i]);
+      return dot(std::span<const uint64_t>(column));
+   }
+
+   std::vector<long> forward, backward;
+
+private:
+   template <typename T>
+   Result dot(std::span<const T> numbers) const
+   {
+      assert(numbers.size() == size());
+      uint64_t back = 0, front = 0;
+      for (size_t i = 0; i < size(); ++i)
+      {
+         back += uint64_t(forward[i]) * uint64_t(numbers[i]);
+         front += uint64_t(backward[i]) * uint64_t(numbers[i]);
+      }
+      return {.front = long(front), .back = long(back)};
+   }
+};
+
+//
+// Forecasts k steps ahead and behind for many series. Each series is parsed once and reduced to
+// the boundary of its difference table, i.e. the first and last number of every level down to the
+// last non-zero one. With d levels, that is Newton's forward/backward interpolation:
+//
+//   ahead(k)  = sum C(k+j-1, j) * last[j]
+//   behind(k) = sum (-1)^j * C(k+j-1, j) * first[j]
+//
+// The coefficients depend only on k and j, so they are shared by all series and any horizon
+// costs O(d) per series. Note that results are 64 bit, so far horizons overflow on high degrees.
+//
+class Forecasts
+{
+public:
+   void add(std::span<const long> numbers)
+   {
+      scratch.assign(numbers.begin(), numbers.end());
+      for (auto n = scratch.size(); n && !std::ranges::all_of(scratch | take(n), isZero); --n)
+      {
+         first.emplace_back(scratch[0]);
+         last.emplace_back(scratch[n - 1]);
+         for (size_t i = 0; i + 1 < n; ++i)
+            scratch[i] = scratch[i + 1] - scratch[i];
+      }
+      offset.emplace_back(first.size());
+   }
+
+   size_t size() const { return offset.size() - 1; }
+
+   Result forecast(size_t series, size_t k) const
+   {
+      return forecast(series, coefficients(k, offset[series + 1] - offset[series]));
+   }
+
+   // batch evaluation of all series for the same horizon
+   std::vector<Result> forecast(size_t k) const
+   {
+      auto c = coefficients(k, degree());
+      std::vector<Result> result(size());
+      for (size_t series = 0; series < size(); ++series)
+         result[series] = forecast(series, c);
+      return result;
+   }
+
+   Result sum(size_t k) const
+   {
+      Result result;
+      for (auto& r : forecast(k))
+         result += r;
+      return result;
+   }
+
+private:
+   static bool isZero(long n) { return n == 0; }
+
+   size_t degree() const
+   {
+      size_t d = 0;
+      for (size_t i = 0; i < size(); ++i)
+         d = std::max(d, offset[i + 1] - offset[i]);
+      return d;
+   }
+
+   // C(k+j-1, j) for j = 0..d-1
+   static std::vector<long> coefficients(size_t k, size_t d)
+   {
+      std::vector<long> c(d);
+      for (long j = 0, cj = 1; j < long(d); ++j)
+      {
+         c[j] = cj;
+         cj = cj * (long(k) + j) / (j + 1);
+      }
+      return c;
+   }
+
+   Result forecast(size_t series, std::span<const long> c) const
+   {
+      Result result;
+      for (size_t j = 0, i = offset[series]; i < offset[series + 1]; ++i, ++j)
+      {
+         result.back += c[j] * last[i];
+         result.front += (j % 2 ? -c[j] : c[j]) * first[i];
+      }
+      return result;
+   }
+
+   std::vector<long> first, last; // boundary of the difference tables, back to back
+   std::vector<size_t> offset{0}; // series i is at [offset[i], offset[i+1])
+   std::vector<long> scratch;
+};
 
 int main(int argc, char* argv[])
 {
    auto file = input(argc, argv);
 
-   Result result;
+   // all sequences of the same length, back to back
+   std::map<size_t, std::vector<long>> sequences;
+   Forecasts forecasts;
    std::string line;
    while (std::getline(file, line))
    {
       std::istringstream ss{line};
       auto numbers = istream<long>(ss) | ranges::to<std::vector>;
-      result += delta(numbers);
-      fmt::println("");
+      forecasts.add(numbers);
+      if (!numbers.empty())
+         sequences[numbers.size()].insert(sequences[numbers.size()].end(), numbers.begin(),
+                                          numbers.end());
    }
 
+   //
+   // Longer sequences would overflow the kernel's coefficients. Their difference tables are
+   // reduced to the last non-zero level by Forecasts, which only needs small coefficients.
+   //
+   Result result;
+   Forecasts longer;
+   for (auto& [n, numbers] : sequences)
+   {
+      if (n > Kernel::MAX_LENGTH)
+      {
+         for (size_t i = 0; i < numbers.size(); i += n)
+            longer.add(std::span(numbers).subspan(i, n));
+         continue;
+      }
+
+      Kernel kernel(n);
+      fmt::println("n={}: {} sequences, forward=[{}], backward=[{}]", n, numbers.size() / n,
+                   fmt::join(kernel.forward, " "), fmt::join(kernel.backward, " "));
+      result += kernel.sum(numbers);
+   }
+   result += longer.sum(1);
+
    fmt::println("A: {} B: {}", result.back, result.front);
+
+   auto check = forecasts.sum(1);
+   assert(check.back == result.back && check.front == result.front);
+   for (size_t k : {2, 10})
+   {
+      auto forecast = forecasts.sum(k);
+      fmt::println("{} steps: ahead {}, behind {}", k, forecast.back, forecast.front);
+   }
 }
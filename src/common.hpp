@@ -1,5 +1,11 @@
+#include <cassert>
+#include <compare>
+#include <cstddef>
 #include <filesystem>
+#include <iterator>
 #include <optional>
+#include <ranges>
+#include <type_traits>
 namespace fs = std::filesystem;
 
 #include <fmt/ostream.h>
@@ -40,4 +46,211 @@ struct formatter<std::optional<T>> : fmt::formatter<T>
       return fmt::format_to(ctx.out(), "NO VALUE");
    }
 };
-} // namespace fmt
\ No newline at end of file
+} // namespace fmt
+// -------------------------------------------------------------------------------------------------
+
+//
+// Zero-copy 2D views into a flat buffer. A view is an origin, a stride to the next row and a
+// stride to the next column, so rotations, transposes and sub-rectangles only change these
+// numbers and never copy cells. Like std::span, views are shallow: use GridView<const T> for
+// read-only access, which any GridView<T> converts to.
+//
+// Iterators keep the first cell and an index, and only form a pointer when dereferenced. For
+// flipped, rotated or transposed views, the cell past the end can lie outside of the buffer, and
+// merely computing such a pointer would be undefined.
+//
+template <typename T>
+struct StrideIterator
+{
+   T* p0 = nullptr;
+   std::ptrdiff_t d = 0;
+   std::ptrdiff_t i = 0;
+
+   using value_type = std::remove_cv_t<T>;
+   using difference_type = std::ptrdiff_t;
+
+   T& operator*() const { return p0[i * d]; }
+   T& operator[](difference_type n) const { return p0[(i + n) * d]; }
+
+   StrideIterator& operator++()
+   {
+      ++i;
+      return *this;
+   }
+   StrideIterator& operator--()
+   {
+      --i;
+      return *this;
+   }
+   StrideIterator operator++(int) // NOLINT(cert-dcl21-cpp)
+   {
+      auto temp = *this;
+      ++i;
+      return temp;
+   }
+   StrideIterator operator--(int) // NOLINT(cert-dcl21-cpp)
+   {
+      auto temp = *this;
+      --i;
+      return temp;
+   }
+   StrideIterator& operator+=(difference_type n)
+   {
+      i += n;
+      return *this;
+   }
+   StrideIterator& operator-=(difference_type n)
+   {
+      i -= n;
+      return *this;
+   }
+
+   friend StrideIterator operator+(StrideIterator it, difference_type n) { return it += n; }
+   friend StrideIterator operator+(difference_type n, StrideIterator it) { return it += n; }
+   friend StrideIterator operator-(StrideIterator it, difference_type n) { return it -= n; }
+   difference_type operator-(const StrideIterator& other) const { return i - other.i; }
+
+   // only iterators of the same row are comparable
+   bool operator==(const StrideIterator& other) const { return i == other.i; }
+   auto operator<=>(const StrideIterator& other) const { return i <=> other.i; }
+};
+
+// a single row of a view, with the cells being 'dx' apart
+template <typename T>
+struct GridRow
+{
+   T* p0 = nullptr;
+   std::ptrdiff_t dx = 0;
+   size_t w = 0;
+
+   size_t size() const { return w; }
+   T& operator[](size_t x) const { return p0[std::ptrdiff_t(x) * dx]; }
+   auto begin() const { return StrideIterator<T>{p0, dx, 0}; }
+   auto end() const { return StrideIterator<T>{p0, dx, std::ptrdiff_t(w)}; }
+};
+
+template <typename T>
+struct GridRowIterator
+{
+   T* p0 = nullptr; // first cell of the first row
+   std::ptrdiff_t dy = 0, dx = 0;
+   size_t w = 0;
+   std::ptrdiff_t y = 0;
+
+   using value_type = GridRow<T>;
+   using difference_type = std::ptrdiff_t;
+
+   GridRow<T> operator*() const { return {p0 + y * dy, dx, w}; }
+   GridRow<T> operator[](difference_type n) const { return *(*this + n); }
+
+   GridRowIterator& operator++() { return *this += 1; }
+   GridRowIterator& operator--() { return *this -= 1; }
+   GridRowIterator operator++(int) // NOLINT(cert-dcl21-cpp)
+   {
+      auto temp = *this;
+      ++*this;
+      return temp;
+   }
+   GridRowIterator operator--(int) // NOLINT(cert-dcl21-cpp)
+   {
+      auto temp = *this;
+      --*this;
+      return temp;
+   }
+   GridRowIterator& operator+=(difference_type n)
+   {
+      y += n;
+      return *this;
+   }
+   GridRowIterator& operator-=(difference_type n)
+   {
+      y -= n;
+      return *this;
+   }
+
+   friend GridRowIterator operator+(GridRowIterator i, difference_type n) { return i += n; }
+   friend GridRowIterator operator+(difference_type n, GridRowIterator i) { return i += n; }
+   friend GridRowIterator operator-(GridRowIterator i, difference_type n) { return i -= n; }
+   difference_type operator-(const GridRowIterator& other) const { return y - other.y; }
+
+   // only iterators of the same view are comparable
+   bool operator==(const GridRowIterator& other) const { return y == other.y; }
+   auto operator<=>(const GridRowIterator& other) const { return y <=> other.y; }
+};
+
+template <typename T>
+struct GridView
+{
+   T* p0 = nullptr;
+   std::ptrdiff_t dy = 0, dx = 0; // delta to go to the next row / column
+   size_t w = 0, h = 0;
+
+   // row-major buffer, with 'stride' cells from one row to the next
+   static GridView flat(T* data, size_t w, size_t h, std::ptrdiff_t stride)
+   {
+      return GridView{data, stride, 1, w, h};
+   }
+   static GridView flat(T* data, size_t w, size_t h) { return flat(data, w, h, w); }
+
+   template <typename U = T>
+      requires(!std::is_const_v<U>)
+   operator GridView<const U>() const
+   {
+      return {p0, dy, dx, w, h};
+   }
+
+   size_t width() const { return w; }
+   size_t height() const { return h; }
+   bool contains(std::ptrdiff_t x, std::ptrdiff_t y) const
+   {
+      return x >= 0 && x < std::ptrdiff_t(w) && y >= 0 && y < std::ptrdiff_t(h);
+   }
+
+   T* pos(std::ptrdiff_t x, std::ptrdiff_t y) const { return p0 + y * dy + x * dx; }
+   T& at(std::ptrdiff_t x, std::ptrdiff_t y) const
+   {
+      assert(contains(x, y));
+      return *pos(x, y);
+   }
+
+   GridRow<T> row(size_t y) const { return {pos(0, y), dx, w}; }
+   GridRow<T> column(size_t x) const { return {pos(x, 0), dy, h}; }
+   GridRowIterator<T> begin() const { return {p0, dy, dx, w, 0}; }
+   GridRowIterator<T> end() const { return {p0, dy, dx, w, std::ptrdiff_t(h)}; }
+
+   // the rows of the transpose are the columns of this view
+   GridView transpose() const { return {p0, dx, dy, h, w}; }
+
+   // rotated by 90 degrees, counterclockwise: the last column becomes the first row
+   GridView rotateLeft() const { return {pos(w - 1, 0), -dx, dy, h, w}; }
+
+   // rotated by 90 degrees, clockwise: the last row becomes the first column
+   GridView rotateRight() const { return {pos(0, h - 1), dx, -dy, h, w}; }
+
+   GridView flipX() const { return {pos(w - 1, 0), dy, -dx, w, h}; }
+   GridView flipY() const { return {pos(0, h - 1), -dy, dx, w, h}; }
+
+   GridView sub(size_t x, size_t y, size_t sub_w, size_t sub_h) const
+   {
+      assert(x + sub_w <= w && y + sub_h <= h);
+      return {pos(x, y), dy, dx, sub_w, sub_h};
+   }
+};
+
+// views only point into the buffer, so their iterators stay valid after the view is gone
+template <typename T>
+inline constexpr bool std::ranges::enable_borrowed_range<GridRow<T>> = true;
+template <typename T>
+inline constexpr bool std::ranges::enable_borrowed_range<GridView<T>> = true;
+template <typename T>
+inline constexpr bool std::ranges::enable_view<GridRow<T>> = true;
+template <typename T>
+inline constexpr bool std::ranges::enable_view<GridView<T>> = true;
+
+static_assert(std::random_access_iterator<StrideIterator<char>>);
+static_assert(std::random_access_iterator<StrideIterator<const char>>);
+static_assert(std::random_access_iterator<GridRowIterator<char>>);
+static_assert(std::ranges::random_access_range<GridRow<char>>);
+static_assert(std::ranges::random_access_range<GridView<char>>);
+static_assert(std::ranges::sized_range<GridView<char>>);
+static_assert(std::ranges::borrowed_range<GridView<char>> && std::ranges::view<GridView<char>>);
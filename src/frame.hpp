@@ -0,0 +1,102 @@
+#pragma once
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#include <fmt/format.h>
+
+struct Color
+{
+   uint8_t r = 0, g = 0, b = 0;
+   static constexpr Color rgb(uint32_t c)
+   {
+      return {uint8_t(c >> 16), uint8_t(c >> 8), uint8_t(c)};
+   }
+};
+
+//
+// Color of the xterm 256 color palette, as used with "\x1b[48;5;{}m".
+//
+constexpr Color xterm256(int i)
+{
+   if (i >= 232) // grayscale ramp
+   {
+      auto gray = uint8_t(8 + (i - 232) * 10);
+      return {gray, gray, gray};
+   }
+   if (i >= 16) // 6x6x6 color cube
+   {
+      constexpr uint8_t level[] = {0, 95, 135, 175, 215, 255};
+      i -= 16;
+      return {level[i / 36], level[i / 6 % 6], level[i % 6]};
+   }
+   constexpr uint32_t system[] = {0x000000, 0x800000, 0x008000, 0x808000, 0x000080, 0x800080,
+                                  0x008080, 0xc0c0c0, 0x808080, 0xff0000, 0x00ff00, 0xffff00,
+                                  0x0000ff, 0xff00ff, 0x00ffff, 0xffffff};
+   return Color::rgb(system[i]);
+}
+
+//
+// Terminal frame: Collects a whole frame in a reusable buffer, which is then written with a single
+// call. This is a lot faster than one fmt::print() per cell.
+//
+class Frame
+{
+public:
+   template <typename... Args>
+   void print(fmt::format_string<Args...> format, Args&&... args)
+   {
+      fmt::format_to(std::back_inserter(buffer), format, std::forward<Args>(args)...);
+   }
+
+   void append(std::string_view text) { buffer.append(text); }
+   void append(char c) { buffer.push_back(c); }
+   void newline() { buffer.push_back('\n'); }
+
+   void flush(std::FILE* file = stdout)
+   {
+      std::fwrite(buffer.data(), 1, buffer.size(), file);
+      std::fflush(file);
+      buffer.clear(); // keeps capacity for the next frame
+   }
+
+private:
+   std::string buffer;
+};
+
+// the frame buffer shared by all dumps
+inline Frame& screen()
+{
+   static Frame frame;
+   return frame;
+}
+
+//
+// RGB image with one pixel per cell, written as binary PPM (P6).
+//
+class Image
+{
+public:
+   Image(size_t w, size_t h) : w(w), h(h), pixels(w * h * 3) {}
+
+   void set(size_t x, size_t y, Color c)
+   {
+      auto* p = &pixels[(y * w + x) * 3];
+      p[0] = c.r, p[1] = c.g, p[2] = c.b;
+   }
+
+   void write(const std::filesystem::path& path) const
+   {
+      std::ofstream file(path, std::ios::binary);
+      auto header = fmt::format("P6\n{} {}\n255\n", w, h);
+      file.write(header.data(), header.size());
+      file.write(reinterpret_cast<const char*>(pixels.data()), pixels.size());
+   }
+
+   const size_t w, h;
+
+private:
+   std::vector<uint8_t> pixels;
+};